@@ -0,0 +1,97 @@
+#include "Platform.h"
+#include <cstdlib>
+
+#ifdef _WIN32
+
+#define NOMINMAX
+#include <windows.h>
+#include <conio.h>
+
+void InitializeConsoleInput()
+{
+    // conio reads the console unbuffered and unechoed already.
+}
+
+void RestoreConsoleInput()
+{
+}
+
+bool IsKeyPressed()
+{
+    return _kbhit() != 0;
+}
+
+int ReadKeyPress()
+{
+    return _getch();
+}
+
+void FlushConsoleInput()
+{
+    FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
+}
+
+#else
+
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+termios originalTerminalSettings;
+bool terminalSettingsSaved = false;
+
+void InitializeConsoleInput()
+{
+    if (terminalSettingsSaved || !isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &originalTerminalSettings) != 0)
+    {
+        return;
+    }
+
+    terminalSettingsSaved = true;
+    atexit(RestoreConsoleInput);
+
+    termios rawSettings = originalTerminalSettings;
+    rawSettings.c_lflag &= ~(ICANON | ECHO);
+    rawSettings.c_cc[VMIN] = 1;
+    rawSettings.c_cc[VTIME] = 0;
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &rawSettings);
+}
+
+void RestoreConsoleInput()
+{
+    if (terminalSettingsSaved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &originalTerminalSettings);
+    }
+}
+
+bool IsKeyPressed()
+{
+    pollfd stdinPoll = { STDIN_FILENO, POLLIN, 0 };
+
+    return poll(&stdinPoll, 1, 0) > 0 && (stdinPoll.revents & POLLIN) != 0;
+}
+
+int ReadKeyPress()
+{
+    unsigned char key = 0;
+
+    if (read(STDIN_FILENO, &key, 1) != 1)
+    {
+        return -1;
+    }
+
+    // match what conio reports on Windows
+    if (key == '\n') return '\r';
+    if (key == 127) return '\b';
+
+    return key;
+}
+
+void FlushConsoleInput()
+{
+    tcflush(STDIN_FILENO, TCIFLUSH);
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+    Console input functions the client needs that differ between Windows (conio / Win32 console)
+    and POSIX terminals (termios). Key presses are reported the way conio reports them, so the
+    return key is always '\r' and backspace is always '\b'.
+*/
+
+// Switch the console to unbuffered, unechoed key input. Restored automatically at exit.
+void InitializeConsoleInput();
+
+// Put the console back the way it was before InitializeConsoleInput.
+void RestoreConsoleInput();
+
+// Returns true if a key press is waiting to be read.
+bool IsKeyPressed();
+
+// Returns the next key press, blocking if there is none.
+int ReadKeyPress();
+
+// Throw away anything typed but not yet read.
+void FlushConsoleInput();
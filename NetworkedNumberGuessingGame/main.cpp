@@ -1,10 +1,18 @@
+#ifdef _WIN32
 #define NOMINMAX
+#endif
 #include <enet/enet.h>
 #include <iostream>
-#include <conio.h>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
 #include <thread>
 #include <string>
 #include "GamePacket.h"
+#include "MessageBatch.h"
+#include "Platform.h"
+#include "TimeSync.h"
 
 using namespace std;
 
@@ -15,20 +23,40 @@ ENetPeer* peer;
 string username;
 bool disconnect;
 
-bool acceptingInput = false;
+atomic<bool> acceptingInput(false);
 
 thread inputThread;
 
 int maxNumber;
 
-int acceptingInputStartTime = 0;
-const int timeAllowedForInput = 10;
-
+// The input thread types into messageBuffer while the main thread prints messages over it and
+// counts the prompt down, so both hold inputMutex for these and for the input line on screen.
+mutex inputMutex;
 string messageBuffer = "";
 bool redisplayInput = false;
 
 string inputPrompt = "Please enter your guess: ";
 
+// When the server passes the turn on, on this client's clock, and the seconds left last shown.
+int64_t turnDeadline = 0;
+int64_t displayedSecondsLeft = -1;
+
+// Typing "stats" asks the main thread to print them.
+atomic<bool> statsRequested(false);
+
+ClockSync clockSync;
+LatencyStats promptLatency;     // server sending a prompt to it arriving here
+LatencyStats resultLatency;     // sending a guess to its result arriving
+LatencyStats turnLatency;       // server sending a prompt to the result of the guess arriving
+
+int64_t promptServerSendTime = 0;
+atomic<int64_t> guessSendTime(0);     // set by the input thread when it sends a guess
+
+// Rebuilds the server's dictionary for this connection as message batches arrive.
+MessageDecoder messageDecoder;
+string messageBatchText;
+vector<string_view> messageBatchMessages;
+
 uint32_t GetTime()
 {
     using namespace std::chrono;
@@ -68,6 +96,7 @@ void SendUserInfoGamePacket()
 {
     UserInfoGamePacket userInfoGP;
     userInfoGP.username = username;
+    userInfoGP.flags = UIF_MessageBatch;
 
     // Create a character buffer as long as the game packet size (function defined on the struct)
     size_t dataSize = userInfoGP.size();
@@ -114,10 +143,26 @@ void SendUserGuessGamePacket(int number)
     enet_host_flush(client);
 }
 
+// Unreliable on channel 1, see HandleTimeSyncGamePacket on the server.
+void SendTimeSyncGamePacket()
+{
+    TimeSyncGamePacket timeSyncGP;
+    timeSyncGP.clientSendTime = GetClockMicroseconds();
+
+    char data[sizeof(TimeSyncGamePacket)];
+    TimeSyncGamePacket::serialize(timeSyncGP, data);
+
+    ENetPacket* packet = enet_packet_create(data, timeSyncGP.size(), 0);
+
+    enet_peer_send(peer, 1, packet);
+    enet_host_flush(client);
+}
+
+// Callers hold inputMutex.
 void ClearInputLine()
 {
     // clear whatever user has input from the display
-    for (int i = 0; i < inputPrompt.length() + messageBuffer.length(); i++)
+    for (size_t i = 0; i < inputPrompt.length() + messageBuffer.length(); i++)
     {
         cout << '\b';
         cout << ' ';
@@ -127,6 +172,8 @@ void ClearInputLine()
 
 void CheckIfShouldRedisplayInput()
 {
+    lock_guard<mutex> lock(inputMutex);
+
     if (redisplayInput)
     {
         cout << inputPrompt + messageBuffer;
@@ -137,6 +184,7 @@ void CheckIfShouldRedisplayInput()
 void SendUserGuess()
 {
     int guess = stoi(messageBuffer);
+    guessSendTime = GetClockMicroseconds();
     SendUserGuessGamePacket(guess);
 
     ClearInputLine();
@@ -164,6 +212,12 @@ void ProcessSubmittedInput()
         {
             disconnect = true;
         }
+        else if (messageBuffer == "stats")
+        {
+            ClearInputLine();
+            messageBuffer = "";
+            statsRequested = true;
+        }
         else
         {
             if (IsStringANumber(messageBuffer))
@@ -181,6 +235,14 @@ void ProcessSubmittedInput()
 // User has hit the keyboard.
 void ProcessKeyPress(int input)
 {
+    lock_guard<mutex> lock(inputMutex);
+
+    // the turn may have run out since the key was read
+    if (!acceptingInput)
+    {
+        return;
+    }
+
     char charInput = (char)input;
     if (charInput == '\r')
     {
@@ -213,26 +275,147 @@ void ProcessInput()
         {
             int input = -1;
 
-            if (_kbhit())
+            if (IsKeyPressed())
             {
-                input = _getch();
+                input = ReadKeyPress();
                 ProcessKeyPress(input);
             }
         }
     }
 }
 
-void HandleReceiveMessageGamePacket(ENetEvent event)
+void DisplayMessage(string_view message)
 {
+    lock_guard<mutex> lock(inputMutex);
+
     if (acceptingInput)
     {
         ClearInputLine();
     }
 
-    MessageGamePacket messageGP;
-    MessageGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, messageGP);
+    cout << message << endl;
 
-    cout << messageGP.message << endl;
+    if (acceptingInput)
+    {
+        redisplayInput = true;
+    }
+}
+
+void DisplayStats()
+{
+    DisplayMessage("Stats: " + clockSync.Format());
+    DisplayMessage("Stats: " + promptLatency.Format("prompt"));
+    DisplayMessage("Stats: " + resultLatency.Format("result"));
+    DisplayMessage("Stats: " + turnLatency.Format("turn"));
+}
+
+int64_t GetSecondsLeft()
+{
+    return max<int64_t>(0, (turnDeadline - GetClockMicroseconds() + 999999) / 1000000);
+}
+
+// The prompt with the time left and the ping to the server, once the server has sent a deadline.
+string GetInputPrompt()
+{
+    if (turnDeadline == 0)
+    {
+        return "Please enter your guess: ";
+    }
+
+    displayedSecondsLeft = GetSecondsLeft();
+
+    return "Please enter your guess (" + to_string(displayedSecondsLeft) + "s left"
+        + (clockSync.IsSynced() ? ", ping " + FormatMilliseconds((double)clockSync.GetRoundTripTime()) : "") + "): ";
+}
+
+// Count the prompt down a second at a time, and stop taking input once the server has passed the turn on.
+void UpdateInputPrompt()
+{
+    if (!acceptingInput || turnDeadline == 0 || GetSecondsLeft() == displayedSecondsLeft)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(inputMutex);
+
+    ClearInputLine();
+
+    if (GetSecondsLeft() == 0)
+    {
+        acceptingInput = false;
+        messageBuffer = "";
+        cout << "System: Out of time." << endl;
+        return;
+    }
+
+    inputPrompt = GetInputPrompt();
+    redisplayInput = true;
+}
+
+void HandleReceiveTimeSyncGamePacket(ENetEvent event)
+{
+    TimeSyncGamePacket timeSyncGP;
+
+    if (TimeSyncGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, timeSyncGP))
+    {
+        clockSync.AddSample(timeSyncGP, GetClockMicroseconds());
+    }
+}
+
+void HandleReceiveMessageGamePacket(ENetEvent event)
+{
+    DisplayMessage(MessageGamePacket::deserializeView((char*)event.packet->data, event.packet->dataLength));
+}
+
+void HandleReceiveMessageBatchGamePacket(ENetEvent event)
+{
+    if (!MessageBatchGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength,
+        messageDecoder, messageBatchText, messageBatchMessages))
+    {
+        cout << "System: Received a malformed message batch." << endl;
+    }
+
+    for (string_view message : messageBatchMessages)
+    {
+        DisplayMessage(message);
+    }
+}
+
+void HandleReceiveGuessResultGamePacket(ENetEvent event)
+{
+    GuessResultGamePacket guessResultGP;
+    GuessResultGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, guessResultGP);
+
+    // the result of our own guess
+    if (guessSendTime != 0)
+    {
+        int64_t now = GetClockMicroseconds();
+
+        resultLatency.Add(now - guessSendTime);
+
+        if (promptServerSendTime != 0 && clockSync.IsSynced())
+        {
+            turnLatency.Add(now - clockSync.ToClientTime(promptServerSendTime));
+        }
+
+        guessSendTime = 0;
+        promptServerSendTime = 0;
+    }
+
+    if (guessResultGP.hint == GH_Correct)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(inputMutex);
+
+    if (acceptingInput)
+    {
+        ClearInputLine();
+    }
+
+    cout << "System Message: The number is " << (guessResultGP.hint == GH_Higher ? "higher" : "lower") << " than "
+        << guessResultGP.guess << ". It is between " << guessResultGP.low << " and " << guessResultGP.high << "." << endl;
 
     if (acceptingInput)
     {
@@ -242,11 +425,35 @@ void HandleReceiveMessageGamePacket(ENetEvent event)
 
 void HandleReceiveUserGuessGamePacket(ENetEvent event)
 {
+    int64_t now = GetClockMicroseconds();
+
     UserGuessGamePacket userGuessGP;
     UserGuessGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, userGuessGP);
 
-    FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
+    promptServerSendTime = userGuessGP.serverSendTime;
+    guessSendTime = 0;
+    turnDeadline = 0;
+    displayedSecondsLeft = -1;
 
+    if (userGuessGP.serverSendTime != 0)
+    {
+        if (clockSync.IsSynced())
+        {
+            promptLatency.Add(now - clockSync.ToClientTime(userGuessGP.serverSendTime));
+            turnDeadline = clockSync.ToClientTime(userGuessGP.deadline);
+        }
+        else
+        {
+            // close enough until the first sync reply
+            turnDeadline = now + (userGuessGP.deadline - userGuessGP.serverSendTime);
+        }
+    }
+
+    FlushConsoleInput();
+
+    lock_guard<mutex> lock(inputMutex);
+
+    inputPrompt = GetInputPrompt();
     cout << inputPrompt;
 
     maxNumber = userGuessGP.number;
@@ -264,10 +471,22 @@ void HandleEventTypeReceiveGamePacket(ENetEvent event)
         {
             HandleReceiveMessageGamePacket(event);
         }
+        else if (gamePacket->type == PHT_MessageBatch)
+        {
+            HandleReceiveMessageBatchGamePacket(event);
+        }
         else if (gamePacket->type == PHT_UserGuess)
         {
             HandleReceiveUserGuessGamePacket(event);
         }
+        else if (gamePacket->type == PHT_GuessResult)
+        {
+            HandleReceiveGuessResultGamePacket(event);
+        }
+        else if (gamePacket->type == PHT_TimeSync)
+        {
+            HandleReceiveTimeSyncGamePacket(event);
+        }
     }
 }
 
@@ -289,6 +508,8 @@ void LeaveGame()
         case ENET_EVENT_TYPE_DISCONNECT:
             cout << "Disconnection succeeded." << endl;
             return;
+        default:
+            break;
         }
     }
 
@@ -297,7 +518,7 @@ void LeaveGame()
     enet_peer_reset(peer);
 }
 
-int main(int argc, char** argv)
+int main()
 {
     cout << "What is your name?" << endl;
 
@@ -343,6 +564,8 @@ int main(int argc, char** argv)
     {
         cout << "Connected to the game." << endl;
 
+        InitializeConsoleInput();
+
         inputThread = thread(ProcessInput);
 
         SendUserInfoGamePacket();
@@ -360,8 +583,20 @@ int main(int argc, char** argv)
     {
         ENetEvent event;
 
-        /* Wait up to 1000 milliseconds for an event. */
-        while (enet_host_service(client, &event, 1000) > 0)
+        if (peer->state == ENET_PEER_STATE_CONNECTED && clockSync.IsRequestDue(GetClockMicroseconds()))
+        {
+            SendTimeSyncGamePacket();
+        }
+
+        UpdateInputPrompt();
+
+        if (statsRequested.exchange(false))
+        {
+            DisplayStats();
+        }
+
+        /* Wait up to 100 milliseconds for an event, so the countdown and clock sync keep ticking. */
+        while (enet_host_service(client, &event, 100) > 0)
         {
             switch (event.type)
             {
@@ -371,6 +606,13 @@ int main(int argc, char** argv)
                 /* Clean up the packet now that we're done using it. */
                 enet_packet_destroy(event.packet);
 
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                cout << endl << "Disconnected from the server." << endl;
+                disconnect = true;
+
+                break;
+            default:
                 break;
             }
         }
@@ -379,6 +621,8 @@ int main(int argc, char** argv)
     LeaveGame();
     inputThread.join();
 
+    DisplayStats();
+
     if (client != NULL) enet_host_destroy(client);
 
     return EXIT_SUCCESS;
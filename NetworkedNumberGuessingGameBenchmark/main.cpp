@@ -0,0 +1,639 @@
+#include <enet/enet.h>
+#include <atomic>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <random>
+#include <thread>
+#include <string>
+#include <vector>
+#include "GamePacket.h"
+#include "GameLogic.h"
+#include "MessageBatch.h"
+#include "TimeSync.h"
+
+using namespace std;
+
+/*
+    Microbenchmarks for the packet codecs and the game state operations the server runs per event.
+    Usage: NetworkedNumberGuessingGameBenchmark [--out results.json] [--filter name] [--min-time-ms 200]
+
+    Every result reports ns/op, allocations/op and bytes/op. Allocations are counted through the
+    global operator new and through ENet's allocator callbacks, so packet creation is included.
+*/
+
+struct BenchmarkResult
+{
+    string name;
+    size_t roomSize = 0;
+    size_t iterations = 0;
+    double nanosecondsPerOp = 0;
+    double allocationsPerOp = 0;
+    double bytesPerOp = 0;
+};
+
+const size_t roomSizes[] = { 2, 32, 1024, 65536 };
+
+size_t allocationCount = 0;
+size_t allocatedBytes = 0;
+
+vector<BenchmarkResult> results;
+string nameFilter = "";
+chrono::nanoseconds minimumRunTime = chrono::milliseconds(200);
+
+void* CountedAllocate(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+
+    void* memory = malloc(size ? size : 1);
+    if (!memory) throw bad_alloc();
+
+    return memory;
+}
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+void* EnetAllocate(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+
+    return malloc(size);
+}
+
+// Keep the compiler from optimizing away a value the benchmark produced.
+template <typename T>
+void DoNotOptimize(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// Run operation until minimumRunTime has passed, doubling the batch each time, and record the last batch.
+// reset, if given, runs untimed before every batch to put back whatever state the operation builds up.
+template <typename Operation, typename Reset = void (*)()>
+void RunBenchmark(const string& name, size_t roomSize, Operation operation, Reset reset = [] {})
+{
+    if (!nameFilter.empty() && name.find(nameFilter) == string::npos)
+    {
+        return;
+    }
+
+    using namespace std::chrono;
+
+    size_t iterations = 1;
+
+    while (true)
+    {
+        reset();
+
+        size_t allocationsBefore = allocationCount;
+        size_t bytesBefore = allocatedBytes;
+        auto start = steady_clock::now();
+
+        for (size_t i = 0; i < iterations; i++)
+        {
+            operation();
+        }
+
+        auto elapsed = steady_clock::now() - start;
+
+        if (elapsed >= minimumRunTime || iterations >= ((size_t)1 << 30))
+        {
+            BenchmarkResult result;
+            result.name = name;
+            result.roomSize = roomSize;
+            result.iterations = iterations;
+            result.nanosecondsPerOp = (double)duration_cast<nanoseconds>(elapsed).count() / iterations;
+            result.allocationsPerOp = (double)(allocationCount - allocationsBefore) / iterations;
+            result.bytesPerOp = (double)(allocatedBytes - bytesBefore) / iterations;
+
+            cout << name << " (room " << roomSize << "): " << result.nanosecondsPerOp << " ns/op, "
+                << result.allocationsPerOp << " allocs/op, " << result.bytesPerOp << " bytes/op" << endl;
+
+            results.push_back(result);
+            return;
+        }
+
+        iterations *= 2;
+    }
+}
+
+// Stand in for the host: a peer table where every peer is connected and has joined one room.
+struct MockRoom
+{
+    ENetHost host = {};
+    vector<ENetPeer> peers;
+    Room room;
+
+    explicit MockRoom(size_t roomSize) : peers(roomSize)
+    {
+        for (size_t i = 0; i < roomSize; i++)
+        {
+            peers[i].host = &host;
+            peers[i].incomingPeerID = (enet_uint16)i;
+            peers[i].state = ENET_PEER_STATE_CONNECTED;
+        }
+
+        host.peers = peers.data();
+        host.peerCount = peers.size();
+
+        server = &host;
+        players.Clear();
+        room.id = 1;
+
+        for (size_t i = 0; i < roomSize; i++)
+        {
+            PlayerId player = players.Add(&peers[i], (uint32_t)i + 1, "Player" + to_string(i));
+
+            room.members.push_back(&peers[i]);
+            players.roomIds[player] = room.id;
+        }
+    }
+
+    ~MockRoom()
+    {
+        players.Clear();
+        server = nullptr;
+    }
+};
+
+// The I/O thread's side of the outbound ring, minus the actual send.
+void DrainOutboundPackets()
+{
+    OutboundPacket outboundPacket;
+
+    while (outboundPackets.TryPop(outboundPacket))
+    {
+        if (outboundPacket.releasePacket && --outboundPacket.packet->referenceCount == 0)
+        {
+            enet_packet_destroy(outboundPacket.packet);
+        }
+    }
+}
+
+// Keeps draining the outbound ring on another thread, like the I/O thread does, so operations
+// that queue more records than the ring holds don't block forever.
+struct OutboundDrainThread
+{
+    atomic<bool> running{ true };
+    thread worker;
+
+    OutboundDrainThread() : worker([this]() {
+        while (running)
+        {
+            DrainOutboundPackets();
+            this_thread::yield();
+        }
+
+        DrainOutboundPackets();
+    }) {}
+
+    ~OutboundDrainThread()
+    {
+        running = false;
+        worker.join();
+    }
+};
+
+void RunCodecBenchmarks()
+{
+    char buffer[1024];
+
+    GamePacket gamePacket;
+    RunBenchmark("GamePacket::serialize", 0, [&]() {
+        DoNotOptimize(GamePacket::serialize(gamePacket, buffer));
+    });
+    RunBenchmark("GamePacket::deserialize", 0, [&]() {
+        DoNotOptimize(GamePacket::deserialize(buffer, sizeof(buffer), gamePacket));
+    });
+
+    UserInfoGamePacket userInfoGP;
+    userInfoGP.username = "SomeTypicalUsername";
+    RunBenchmark("UserInfoGamePacket::serialize", 0, [&]() {
+        UserInfoGamePacket::serialize(userInfoGP, buffer);
+        DoNotOptimize(buffer);
+    });
+    RunBenchmark("UserInfoGamePacket::deserialize", 0, [&]() {
+        UserInfoGamePacket decoded;
+        UserInfoGamePacket::deserialize(buffer, userInfoGP.size(), decoded);
+        DoNotOptimize(decoded);
+    });
+
+    MessageGamePacket messageGP;
+    messageGP.message = "System Message: It is now SomeTypicalUsername's turn.";
+    RunBenchmark("MessageGamePacket::serialize", 0, [&]() {
+        MessageGamePacket::serialize(messageGP, buffer);
+        DoNotOptimize(buffer);
+    });
+    RunBenchmark("MessageGamePacket::deserialize", 0, [&]() {
+        MessageGamePacket decoded;
+        MessageGamePacket::deserialize(buffer, messageGP.size(), decoded);
+        DoNotOptimize(decoded);
+    });
+
+    UserGuessGamePacket userGuessGP;
+    userGuessGP.number = 42;
+    userGuessGP.serverSendTime = GetClockMicroseconds();
+    userGuessGP.deadline = userGuessGP.serverSendTime + 30000000;
+    RunBenchmark("UserGuessGamePacket::serialize", 0, [&]() {
+        UserGuessGamePacket::serialize(userGuessGP, buffer);
+        DoNotOptimize(buffer);
+    });
+    RunBenchmark("UserGuessGamePacket::deserialize", 0, [&]() {
+        UserGuessGamePacket decoded;
+        UserGuessGamePacket::deserialize(buffer, userGuessGP.size(), decoded);
+        DoNotOptimize(decoded);
+    });
+
+    TimeSyncGamePacket timeSyncGP;
+    timeSyncGP.clientSendTime = 1000;
+    timeSyncGP.serverReceiveTime = 51500;
+    timeSyncGP.serverSendTime = 51600;
+    RunBenchmark("TimeSyncGamePacket::serialize", 0, [&]() {
+        TimeSyncGamePacket::serialize(timeSyncGP, buffer);
+        DoNotOptimize(buffer);
+    });
+    RunBenchmark("TimeSyncGamePacket::deserialize", 0, [&]() {
+        TimeSyncGamePacket decoded;
+        DoNotOptimize(TimeSyncGamePacket::deserialize(buffer, timeSyncGP.size(), decoded));
+        DoNotOptimize(decoded);
+    });
+
+    ClockSync clockSync;
+    int64_t clientReceiveTime = 3000;
+    RunBenchmark("ClockSync::AddSample", 0, [&]() {
+        clockSync.AddSample(timeSyncGP, clientReceiveTime);
+        clientReceiveTime = 3000 + (clientReceiveTime + 7) % 1000;
+        DoNotOptimize(clockSync.GetOffset());
+    });
+
+    // one tick's worth of messages for a player, once the usernames are in the connection dictionary
+    vector<string> tickMessages = {
+        "System Message: Incorrect number guessed (37) by SomeTypicalUsername.",
+        "System Message: It is now AnotherTypicalUsername's turn."
+    };
+
+    MessageEncoder encoder;
+    StringArena words;
+    MessageDecoder decoder;
+    string batch, encoded, decodedText;
+    vector<string_view> decodedMessages;
+
+    MessageBatchGamePacket::begin(batch);
+    for (const string& message : tickMessages) MessageBatchGamePacket::append(batch, message, encoder, words, encoded);
+    MessageBatchGamePacket::deserialize(batch.data(), batch.size(), decoder, decodedText, decodedMessages);
+
+    RunBenchmark("MessageBatchGamePacket::serialize", 0, [&]() {
+        MessageBatchGamePacket::begin(batch);
+        for (const string& message : tickMessages) MessageBatchGamePacket::append(batch, message, encoder, words, encoded);
+        DoNotOptimize(batch);
+    });
+    RunBenchmark("MessageBatchGamePacket::deserialize", 0, [&]() {
+        MessageBatchGamePacket::deserialize(batch.data(), batch.size(), decoder, decodedText, decodedMessages);
+        DoNotOptimize(decodedMessages);
+    });
+
+    // steady state size, whether or not the benchmarks above ran
+    MessageBatchGamePacket::begin(batch);
+    for (const string& message : tickMessages) MessageBatchGamePacket::append(batch, message, encoder, words, encoded);
+
+    size_t plainSize = 0;
+
+    for (const string& message : tickMessages)
+    {
+        MessageGamePacket plainGP;
+        plainGP.message = message;
+        plainSize += plainGP.size();
+    }
+
+    cout << "MessageBatchGamePacket: " << tickMessages.size() << " messages in " << batch.size() << " bytes, "
+        << plainSize << " bytes as MessageGamePackets" << endl;
+}
+
+void RunGameStateBenchmarks()
+{
+    RunBenchmark("GetRandomNumber", 0, [&]() {
+        DoNotOptimize(GetRandomNumber(serverConfig.maxNumber));
+    });
+
+    for (size_t roomSize : roomSizes)
+    {
+        MockRoom mockRoom(roomSize);
+        Room& room = mockRoom.room;
+
+        // a full rotation on average, the same way turns move through the room
+        RunBenchmark("GetNextPeer", roomSize, [&]() {
+            AssignNextPeer(room);
+            DoNotOptimize(room.activePeer);
+        });
+
+        RunBenchmark("GetNumberOfConnections", roomSize, [&]() {
+            DoNotOptimize(GetNumberOfConnections());
+        });
+
+        OutboundDrainThread drainThread;
+        GetRoomSubscribers(room, ST_Turns);
+
+        RunBenchmark("BroadcastMessage", roomSize, [&]() {
+            BroadcastMessage(room, ST_Turns, "System Message: It is now " + GetUserNameFromPeer(&mockRoom.peers[0]) + "'s turn.");
+        });
+
+        // every other player only wants what they need to play
+        for (size_t i = 1; i < roomSize; i += 2) players.subscriptionTopics[i] = ST_Room | ST_Results;
+        room.subscribersDirty = true;
+        GetRoomSubscribers(room, ST_Turns);
+
+        RunBenchmark("BroadcastMessage (half subscribed)", roomSize, [&]() {
+            BroadcastMessage(room, ST_Turns, "System Message: It is now " + GetUserNameFromPeer(&mockRoom.peers[0]) + "'s turn.");
+        });
+
+        for (size_t i = 0; i < roomSize; i++) players.subscriptionTopics[i] = ST_All;
+        for (size_t i = 0; i < roomSize; i++) players.flags[i] = PF_MessageBatching;
+        room.subscribersDirty = true;
+        GetRoomSubscribers(room, ST_Turns);
+
+        RunBenchmark("BroadcastMessage (batched)", roomSize, [&]() {
+            BroadcastMessage(room, ST_Turns, "System Message: It is now " + GetUserNameFromPeer(&mockRoom.peers[0]) + "'s turn.");
+            FlushMessageBatches();
+        });
+
+        // the connection dictionaries are protocol state rather than game state, so shown apart
+        size_t perPlayer = GetRoomMemoryUsage(room) / roomSize;
+
+        cout << "Memory (room " << roomSize << "): " << perPlayer << " bytes per player, "
+            << perPlayer - sizeof(MessageEncoder) << " without the message dictionary" << endl;
+
+        // one whole turn through the room's lifecycle: the guess event, its broadcasts and the next prompt
+        room.maxNumber = 100;
+        room.numberToGuess = 1;
+        room.guessTracker.Reset(room.maxNumber);
+        room.gameStarted = true;
+        StartRoom(room);
+
+        // every turn queues a timer and a guess; emptied between batches so the heap and the
+        // history stay the size a real round would have (clearing keeps their capacity)
+        RunBenchmark("Turn (wrong guess)", roomSize, [&]() {
+            PostRoomEvent(room, RE_Guess, 0);
+            FlushMessageBatches();
+        }, [&]() {
+            while (!roomTimers.empty()) roomTimers.pop();
+            room.guessTracker.Reset(room.maxNumber);
+        });
+    }
+}
+
+// Here the room size is the number of players already waiting in the lobby.
+void RunLobbyBenchmarks()
+{
+    for (size_t queueSize : roomSizes)
+    {
+        mt19937 randomEngine(1234);
+        uniform_int_distribution<uint32_t> roundTripTimeDistribution(10, 400);
+        uniform_real_distribution<float> winRateDistribution(0.0f, 1.0f);
+
+        vector<ENetPeer> peers(queueSize + 1);
+        auto now = chrono::steady_clock::now();
+
+        auto makeEntry = [&](ENetPeer* peer) {
+            LobbyEntry entry;
+            entry.peer = peer;
+            entry.roundTripTime = roundTripTimeDistribution(randomEngine);
+            entry.winRate = winRateDistribution(randomEngine);
+            entry.enqueueTime = now;
+            return entry;
+        };
+
+        Lobby waiting;
+
+        for (size_t i = 0; i < queueSize; i++)
+        {
+            waiting.Enqueue(makeEntry(&peers[i]));
+        }
+
+        LobbyEntry extra = makeEntry(&peers[queueSize]);
+
+        RunBenchmark("Lobby::Enqueue+Remove", queueSize, [&]() {
+            waiting.Enqueue(extra);
+            DoNotOptimize(waiting.Remove(extra.peer));
+        });
+
+        // form a room of 4 and put the same players back, so the queue size stays put
+        vector<LobbyEntry> members;
+
+        RunBenchmark("Lobby::TryFormRoom", queueSize, [&]() {
+            if (waiting.TryFormRoom(now, 4, 2, chrono::milliseconds(0), members))
+            {
+                for (const LobbyEntry& member : members)
+                {
+                    waiting.Enqueue(member);
+                }
+            }
+
+            DoNotOptimize(members);
+        });
+
+        // The worst case for a tick: nobody can make a room and nobody has timed out. At most four
+        // players share each rating and the spread is zero, so rooms of 8 never fill. A newcomer who
+        // matches nobody joins and leaves each tick, so there's always someone to try.
+        Lobby unmatchable;
+        unmatchable.matchSpread = 0;
+
+        auto makeUnmatchableEntry = [&](size_t i) {
+            size_t slot = i % ((Lobby::maxRoundTripTimeBucket + 1) * 1001);
+
+            LobbyEntry entry;
+            entry.peer = &peers[i];
+            entry.roundTripTime = (uint32_t)(slot / 1001 * Lobby::roundTripTimeBucket);
+            entry.winRate = ((slot % 1001) + 0.5f) / 1000.0f;
+            entry.enqueueTime = now;
+            return entry;
+        };
+
+        for (size_t i = 0; i < queueSize; i++)
+        {
+            unmatchable.Enqueue(makeUnmatchableEntry(i));
+        }
+
+        LobbyEntry newcomer = makeUnmatchableEntry(queueSize);
+
+        RunBenchmark("Lobby::TryFormRoom (unmatchable)", queueSize, [&]() {
+            unmatchable.Enqueue(newcomer);
+            DoNotOptimize(unmatchable.TryFormRoom(now, 8, 2, chrono::hours(1), members));
+            unmatchable.Remove(newcomer.peer);
+        });
+    }
+}
+
+void RunGuessAnalyticsBenchmarks()
+{
+    const int largeMaxNumber = 1 << 30;
+
+    GuessTracker tracker;
+    tracker.Reset(largeMaxNumber);
+    int nextGuess = 1;
+
+    // a very wide range, so any per guess cost that depends on maxNumber shows up
+    RunBenchmark("GuessTracker::RecordGuess", 0, [&]() {
+        DoNotOptimize(tracker.RecordGuess(nextGuess, largeMaxNumber));
+        nextGuess = nextGuess % 4096 + 1;
+        if (tracker.history.size() >= 4096) tracker.Reset(largeMaxNumber);
+    });
+
+    // here the room size is the number of rooms scored at once, each with a round of random guesses
+    for (size_t roomCount : roomSizes)
+    {
+        mt19937 randomEngine(1234);
+        uniform_int_distribution<int> numberDistribution(1, serverConfig.maxNumber);
+
+        vector<vector<int>> streams(roomCount);
+        vector<const vector<int>*> streamPointers(roomCount);
+        vector<int> targets(roomCount);
+
+        for (size_t room = 0; room < roomCount; room++)
+        {
+            targets[room] = numberDistribution(randomEngine);
+            streams[room].resize(10);
+
+            for (int& guess : streams[room])
+            {
+                guess = numberDistribution(randomEngine);
+            }
+
+            streams[room].back() = targets[room];
+            streamPointers[room] = &streams[room];
+        }
+
+        RunBenchmark("ScoreGuessStreams", roomCount, [&]() {
+            DoNotOptimize(ScoreGuessStreams(streamPointers, targets, serverConfig.maxNumber));
+        });
+    }
+}
+
+void RunCheckpointBenchmarks()
+{
+    string path = (filesystem::temp_directory_path() / "nngg-benchmark.ckpt").string();
+    string error;
+    RoomCheckpointFile checkpoint;
+
+    if (!checkpoint.Open(path, true, error))
+    {
+        cerr << "Skipping checkpoint benchmarks: " << error << endl;
+        return;
+    }
+
+    checkpoint.Reset();
+
+    // the per room cost of a checkpoint: snapshot a dirty room and copy it into its slot
+    MockRoom mockRoom(4);
+    mockRoom.room.guessTracker.Reset(100);
+    int slot = checkpoint.AllocateSlot();
+    RoomSnapshot snapshot;
+
+    RunBenchmark("RoomCheckpoint (snapshot + write)", 4, [&]() {
+        SnapshotRoom(mockRoom.room, snapshot);
+        checkpoint.WriteSlot(slot, snapshot);
+    });
+
+    checkpoint.Close();
+    filesystem::remove(path);
+}
+
+void WriteJsonString(ostream& out, const string& value)
+{
+    out << '"';
+
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+
+    out << '"';
+}
+
+bool WriteResults(const string& path)
+{
+    ofstream out(path);
+
+    if (!out)
+    {
+        return false;
+    }
+
+    out << "{\n  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+
+        out << "    { \"name\": ";
+        WriteJsonString(out, result.name);
+        out << ", \"room_size\": " << result.roomSize
+            << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_op\": " << result.nanosecondsPerOp
+            << ", \"allocs_per_op\": " << result.allocationsPerOp
+            << ", \"bytes_per_op\": " << result.bytesPerOp << " }"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+
+    out << "  ]\n}\n";
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    string outputPath = "";
+
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+
+        if (argument == "--out" && i + 1 < argc) outputPath = argv[++i];
+        else if (argument == "--filter" && i + 1 < argc) nameFilter = argv[++i];
+        else if (argument == "--min-time-ms" && i + 1 < argc) minimumRunTime = chrono::milliseconds(atoi(argv[++i]));
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--out results.json] [--filter name] [--min-time-ms 200]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    ENetCallbacks callbacks = { EnetAllocate, free, abort };
+
+    if (enet_initialize_with_callbacks(ENET_VERSION, &callbacks) != 0)
+    {
+        fprintf(stderr, "An error occurred while initializing ENet.\n");
+        return EXIT_FAILURE;
+    }
+
+    atexit(enet_deinitialize);
+
+    RunCodecBenchmarks();
+    RunGameStateBenchmarks();
+    RunLobbyBenchmarks();
+    RunCheckpointBenchmarks();
+    RunGuessAnalyticsBenchmarks();
+
+    if (!outputPath.empty() && !WriteResults(outputPath))
+    {
+        cerr << "Could not write " << outputPath << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,401 @@
+#include <enet/enet.h>
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include "GamePacket.h"
+#include "MessageBatch.h"
+#include "TimeSync.h"
+
+using namespace std;
+
+/*
+    Headless client that joins the game and answers every input prompt on its own.
+    Usage: NetworkedNumberGuessingGameBot [--quiet] [username] [host] [port]
+    With --quiet the bot only subscribes to what it needs to play: its room and the guess results.
+
+    Keeps its clock synced with the server's and prints its latency counters every
+    statsReportInterval turns and when it leaves, as "[username] stats ..." lines.
+*/
+
+ENetAddress address;
+ENetHost* client;
+ENetPeer* peer;
+
+string username = "Bot";
+string hostName = "127.0.0.1";
+enet_uint16 port = 1234;
+
+bool quiet = false;
+
+volatile sig_atomic_t disconnect = 0;
+
+mt19937 randomEngine;
+
+// Range the number is known to be in, narrowed by every guess result the room sees. 0 means unknown.
+int knownLow = 0;
+int knownHigh = 0;
+
+MessageDecoder messageDecoder;
+string messageBatchText;
+vector<string_view> messageBatchMessages;
+
+ClockSync clockSync;
+LatencyStats promptLatency;     // server sending a prompt to it arriving here
+LatencyStats resultLatency;     // sending a guess to its result arriving
+LatencyStats turnLatency;       // server sending a prompt to the result of the guess arriving
+
+int64_t promptServerSendTime = 0;
+int64_t guessSendTime = 0;
+
+const uint64_t statsReportInterval = 10;
+
+void HandleInterruptSignal(int)
+{
+    disconnect = 1;
+}
+
+bool CreateClient()
+{
+    client = enet_host_create(NULL /* create a client host */,
+        1 /* only allow 1 outgoing connection */,
+        2 /* allow up 2 channels to be used, 0 and 1 */,
+        0 /* assume any amount of incoming bandwidth */,
+        0 /* assume any amount of outgoing bandwidth */);
+
+    return client != NULL;
+}
+
+void SendUserInfoGamePacket()
+{
+    UserInfoGamePacket userInfoGP;
+    userInfoGP.username = username;
+    userInfoGP.flags = UIF_MessageBatch;
+
+    size_t dataSize = userInfoGP.size();
+    char* data = new char[dataSize];
+
+    UserInfoGamePacket::serialize(userInfoGP, data);
+
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    enet_peer_send(peer, 0, packet);
+    enet_host_flush(client);
+}
+
+void SendSubscribeGamePacket(uint8_t topics)
+{
+    SubscribeGamePacket subscribeGP;
+    subscribeGP.topics = topics;
+
+    size_t dataSize = subscribeGP.size();
+    char* data = new char[dataSize];
+
+    SubscribeGamePacket::serialize(subscribeGP, data);
+
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    enet_peer_send(peer, 0, packet);
+    enet_host_flush(client);
+}
+
+// Unreliable on channel 1, see HandleTimeSyncGamePacket on the server.
+void SendTimeSyncGamePacket()
+{
+    TimeSyncGamePacket timeSyncGP;
+    timeSyncGP.clientSendTime = GetClockMicroseconds();
+
+    char data[sizeof(TimeSyncGamePacket)];
+    TimeSyncGamePacket::serialize(timeSyncGP, data);
+
+    ENetPacket* packet = enet_packet_create(data, timeSyncGP.size(), 0);
+
+    enet_peer_send(peer, 1, packet);
+    enet_host_flush(client);
+}
+
+void SendUserGuessGamePacket(int number)
+{
+    UserGuessGamePacket userGuessGP;
+    userGuessGP.number = number;
+
+    size_t dataSize = userGuessGP.size();
+    char* data = new char[dataSize];
+
+    UserGuessGamePacket::serialize(userGuessGP, data);
+
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    guessSendTime = GetClockMicroseconds();
+
+    enet_peer_send(peer, 0, packet);
+    enet_host_flush(client);
+}
+
+void WriteStats()
+{
+    cout << "[" << username << "] stats " << clockSync.Format() << " | " << promptLatency.Format("prompt") << " | "
+        << resultLatency.Format("result") << " | " << turnLatency.Format("turn") << endl;
+}
+
+void HandleReceiveTimeSyncGamePacket(ENetEvent event)
+{
+    TimeSyncGamePacket timeSyncGP;
+
+    if (TimeSyncGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, timeSyncGP))
+    {
+        clockSync.AddSample(timeSyncGP, GetClockMicroseconds());
+    }
+}
+
+void HandleReceiveMessageGamePacket(ENetEvent event)
+{
+    cout << "[" << username << "] " << MessageGamePacket::deserializeView((char*)event.packet->data, event.packet->dataLength) << endl;
+}
+
+void HandleReceiveMessageBatchGamePacket(ENetEvent event)
+{
+    if (!MessageBatchGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength,
+        messageDecoder, messageBatchText, messageBatchMessages))
+    {
+        cerr << "[" << username << "] malformed message batch" << endl;
+    }
+
+    for (string_view message : messageBatchMessages)
+    {
+        cout << "[" << username << "] " << message << endl;
+    }
+}
+
+void HandleReceiveGuessResultGamePacket(ENetEvent event)
+{
+    GuessResultGamePacket guessResultGP;
+    GuessResultGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, guessResultGP);
+
+    // the result of our own guess
+    if (guessSendTime != 0)
+    {
+        int64_t now = GetClockMicroseconds();
+
+        resultLatency.Add(now - guessSendTime);
+
+        if (promptServerSendTime != 0 && clockSync.IsSynced())
+        {
+            turnLatency.Add(now - clockSync.ToClientTime(promptServerSendTime));
+        }
+
+        guessSendTime = 0;
+        promptServerSendTime = 0;
+
+        if (resultLatency.count % statsReportInterval == 0)
+        {
+            WriteStats();
+        }
+    }
+
+    if (guessResultGP.hint == GH_Correct)
+    {
+        // next round starts from the full range again
+        knownLow = 0;
+        knownHigh = 0;
+    }
+    else
+    {
+        knownLow = guessResultGP.low;
+        knownHigh = guessResultGP.high;
+    }
+}
+
+// The prompt carries the maximum number. Binary search the known range, or guess at random before any hints.
+void HandleReceiveUserGuessGamePacket(ENetEvent event)
+{
+    int64_t now = GetClockMicroseconds();
+
+    UserGuessGamePacket userGuessGP;
+    UserGuessGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, userGuessGP);
+
+    promptServerSendTime = userGuessGP.serverSendTime;
+
+    if (userGuessGP.serverSendTime != 0 && clockSync.IsSynced())
+    {
+        promptLatency.Add(now - clockSync.ToClientTime(userGuessGP.serverSendTime));
+    }
+
+    int maxNumber = userGuessGP.number > 0 ? userGuessGP.number : 1;
+
+    if (knownHigh >= knownLow && knownLow >= 1 && knownHigh <= maxNumber)
+    {
+        SendUserGuessGamePacket(knownLow + (knownHigh - knownLow) / 2);
+        return;
+    }
+
+    uniform_int_distribution<int> guessDistribution(1, maxNumber);
+    SendUserGuessGamePacket(guessDistribution(randomEngine));
+}
+
+void HandleEventTypeReceiveGamePacket(ENetEvent event)
+{
+    GamePacket* gamePacket = (GamePacket*)event.packet->data;
+
+    if (gamePacket)
+    {
+        if (gamePacket->type == PHT_Message)
+        {
+            HandleReceiveMessageGamePacket(event);
+        }
+        else if (gamePacket->type == PHT_MessageBatch)
+        {
+            HandleReceiveMessageBatchGamePacket(event);
+        }
+        else if (gamePacket->type == PHT_UserGuess)
+        {
+            HandleReceiveUserGuessGamePacket(event);
+        }
+        else if (gamePacket->type == PHT_GuessResult)
+        {
+            HandleReceiveGuessResultGamePacket(event);
+        }
+        else if (gamePacket->type == PHT_TimeSync)
+        {
+            HandleReceiveTimeSyncGamePacket(event);
+        }
+    }
+}
+
+void LeaveGame()
+{
+    ENetEvent event;
+    enet_peer_disconnect(peer, 0);
+
+    while (enet_host_service(client, &event, 3000) > 0)
+    {
+        switch (event.type)
+        {
+        case ENET_EVENT_TYPE_RECEIVE:
+            enet_packet_destroy(event.packet);
+            break;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            return;
+        default:
+            break;
+        }
+    }
+
+    enet_peer_reset(peer);
+}
+
+int main(int argc, char** argv)
+{
+    int argument = 1;
+
+    if (argument < argc && string(argv[argument]) == "--quiet")
+    {
+        quiet = true;
+        argument++;
+    }
+
+    if (argument < argc) username = argv[argument++];
+    if (argument < argc) hostName = argv[argument++];
+    if (argument < argc) port = (enet_uint16)atoi(argv[argument++]);
+
+    randomEngine.seed(random_device{}());
+
+    signal(SIGINT, HandleInterruptSignal);
+    signal(SIGTERM, HandleInterruptSignal);
+
+    if (enet_initialize() != 0)
+    {
+        fprintf(stderr, "An error occurred while initializing ENet.\n");
+        return EXIT_FAILURE;
+    }
+
+    atexit(enet_deinitialize);
+
+    if (!CreateClient())
+    {
+        fprintf(stderr,
+            "An error occurred while trying to create an ENet client host.\n");
+        return EXIT_FAILURE;
+    }
+
+    ENetEvent event;
+
+    enet_address_set_host(&address, hostName.c_str());
+    address.port = port;
+
+    peer = enet_host_connect(client, &address, 2, 0);
+    if (peer == NULL)
+    {
+        fprintf(stderr,
+            "No available peers for initiating an ENet connection.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (enet_host_service(client, &event, 5000) > 0 &&
+        event.type == ENET_EVENT_TYPE_CONNECT)
+    {
+        SendUserInfoGamePacket();
+
+        if (quiet)
+        {
+            SendSubscribeGamePacket(ST_Room | ST_Results);
+        }
+    }
+    else
+    {
+        enet_peer_reset(peer);
+        cerr << "Connection to " << hostName << ":" << port << " failed." << endl;
+        enet_host_destroy(client);
+        return EXIT_FAILURE;
+    }
+
+    while (!disconnect)
+    {
+        if (peer->state == ENET_PEER_STATE_CONNECTED && clockSync.IsRequestDue(GetClockMicroseconds()))
+        {
+            SendTimeSyncGamePacket();
+        }
+
+        /* Wait up to 100 milliseconds for an event so signals are noticed quickly. */
+        while (!disconnect && enet_host_service(client, &event, 100) > 0)
+        {
+            switch (event.type)
+            {
+            case ENET_EVENT_TYPE_RECEIVE:
+                HandleEventTypeReceiveGamePacket(event);
+                enet_packet_destroy(event.packet);
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                cout << "[" << username << "] Disconnected by server." << endl;
+                disconnect = 1;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    if (peer->state == ENET_PEER_STATE_CONNECTED)
+    {
+        LeaveGame();
+    }
+
+    WriteStats();
+
+    enet_host_destroy(client);
+
+    return EXIT_SUCCESS;
+}
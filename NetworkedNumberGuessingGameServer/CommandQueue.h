@@ -0,0 +1,186 @@
+#pragma once
+
+#include <enet/enet.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/*
+    Lock-free queues used to stage the server into two threads:
+
+    I/O thread          -> decodes ENet events into fixed-size GameCommands and pushes them
+                           into an MPSC ring (any number of producers, one game logic consumer).
+    Game logic thread   -> drains GameCommands, runs the game rules and pushes OutboundPackets
+                           into an SPSC ring back to the I/O thread.
+    I/O thread          -> drains OutboundPackets, sends them and flushes the host once per tick.
+
+    Both rings are bounded and never allocate after construction.
+*/
+
+const size_t maxUsernameLength = 31;
+
+enum GameCommandType
+{
+    GCT_Invalid,
+    GCT_Connect,
+    GCT_Disconnect,
+    GCT_UserInfo,
+    GCT_UserGuess,
+    GCT_Subscribe,
+    GCT_ReloadConfig
+};
+
+// Everything the game logic needs from an ENet event, copied so the packet can be destroyed right away.
+struct GameCommand
+{
+    GameCommandType type = GCT_Invalid;
+    ENetPeer* peer = nullptr;
+    uint32_t connectId = 0;     // the peer's connectID, which tells its connections apart
+    int numberOfConnections = 0;
+    uint32_t roundTripTime = 0;
+    int number = 0;
+    char username[maxUsernameLength + 1] = {};
+    uint8_t userInfoFlags = 0;
+    uint8_t subscriptionTopics = 0;
+};
+
+// A packet the game logic wants sent. A null peer means broadcast to every peer on the host.
+// With disconnect set the peer is disconnected after anything already queued for it is delivered.
+// The game logic holds a reference on every packet it queues; releasePacket drops it once sent,
+// which lets one packet go out to a whole room across several records.
+// A nonzero connectId must still match the peer's: by the time the I/O thread gets to a record,
+// the connection it was meant for may have gone and ENet reused the peer for another.
+struct OutboundPacket
+{
+    ENetPeer* peer = nullptr;
+    uint32_t connectId = 0;
+    ENetPacket* packet = nullptr;
+    bool releasePacket = false;
+    bool disconnect = false;
+};
+
+// Bounded multi-producer single-consumer ring (Vyukov style sequence numbers per cell).
+template <typename T, size_t Capacity>
+class MpscRingBuffer
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+public:
+    MpscRingBuffer() : cells(new Cell[Capacity])
+    {
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the ring is full.
+    bool TryPush(const T& value)
+    {
+        size_t position = enqueuePosition.load(memory_order_relaxed);
+
+        while (true)
+        {
+            Cell& cell = cells[position & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueuePosition.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only ever called from the single consumer thread. Returns false if the ring is empty.
+    bool TryPop(T& value)
+    {
+        Cell& cell = cells[dequeuePosition & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+
+        if ((intptr_t)sequence - (intptr_t)(dequeuePosition + 1) < 0)
+        {
+            return false;
+        }
+
+        value = cell.value;
+        cell.sequence.store(dequeuePosition + Capacity, memory_order_release);
+        dequeuePosition++;
+
+        return true;
+    }
+
+private:
+    unique_ptr<Cell[]> cells;
+    alignas(64) atomic<size_t> enqueuePosition{ 0 };
+    alignas(64) size_t dequeuePosition = 0;
+};
+
+// Bounded single-producer single-consumer ring.
+template <typename T, size_t Capacity>
+class SpscRingBuffer
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRingBuffer() : values(new T[Capacity]) {}
+
+    // Returns false if the ring is full.
+    bool TryPush(const T& value)
+    {
+        size_t tail = tailPosition.load(memory_order_relaxed);
+
+        if (tail - headPosition.load(memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+
+        values[tail & (Capacity - 1)] = value;
+        tailPosition.store(tail + 1, memory_order_release);
+
+        return true;
+    }
+
+    // Returns false if the ring is empty.
+    bool TryPop(T& value)
+    {
+        size_t head = headPosition.load(memory_order_relaxed);
+
+        if (head == tailPosition.load(memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = values[head & (Capacity - 1)];
+        headPosition.store(head + 1, memory_order_release);
+
+        return true;
+    }
+
+private:
+    unique_ptr<T[]> values;
+    alignas(64) atomic<size_t> headPosition{ 0 };
+    alignas(64) atomic<size_t> tailPosition{ 0 };
+};
@@ -0,0 +1,1531 @@
+#include "GameLogic.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include "GamePacket.h"
+
+using namespace std;
+
+ENetHost* server;
+
+map<int, Room> rooms;
+PlayerArena players;
+Lobby lobby;
+int nextRoomId = 1;
+
+// Recent win rate per username, an exponential moving average over rounds played.
+unordered_map<string, float> winRateByUsername;
+const float winRateSmoothing = 0.2f;
+
+int requiredNumberOfPlayersToBegin = 2;
+
+int timeToWaitForNextGame = 5000;
+
+MpscRingBuffer<GameCommand, 4096> inboundCommands;
+SpscRingBuffer<OutboundPacket, 4096> outboundPackets;
+
+atomic<bool> gameLogicRunning;
+
+bool analyticsEnabled = false;
+
+ServerConfig serverConfig;
+string serverConfigPath = "server.cfg";
+
+// Set by the I/O thread to stop new rounds; set back by the game logic once no round is running.
+atomic<bool> drainRequested;
+atomic<bool> gameLogicDrained;
+atomic<int> drainTimeout(serverConfig.drainTimeout);
+bool drainAnnounced = false;
+
+// Batched messages waiting for the end of the tick. A broadcast's text goes into
+// pendingMessageText once and each recipient's chain of pendingMessages points at it.
+struct PendingMessage
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t next;      // noPendingMessage at the end of a player's chain
+};
+
+string pendingMessageText;
+vector<PendingMessage> pendingMessages;
+vector<PlayerId> playersWithPendingMessages;
+string messageBatchBuffer;
+string encodedMessageBuffer;
+
+// Subscribers to ST_Server among every player, in a room or the lobby.
+TopicSubscribers serverSubscribers;
+bool serverSubscribersDirty = true;
+
+RoomCheckpointFile roomCheckpoint;
+chrono::steady_clock::time_point nextCheckpointTime;
+
+// Username to restored room, for players who haven't reconnected yet.
+unordered_map<string, int> resumingPlayers;
+
+// Deadlines of the rooms' current waits, see UpdateRoomTimers.
+RoomTimerQueue roomTimers;
+vector<RoomTimer> dueRoomTimers;
+
+void WriteLocalMessage(string message)
+{
+    cout << "System: " << message << endl;
+}
+
+// Returns a count based on the number of peers in a CONNECTED state.
+int GetNumberOfConnections()
+{
+    int total = 0;
+
+    for (size_t i = 0; i < server->peerCount; i++)
+    {
+        ENetPeer tempPeer = server->peers[i];
+        if (tempPeer.state == ENET_PEER_STATE_CONNECTED) total++;
+    }
+
+    return total;
+}
+
+// Returns a username saved for a given peer, or an empty string if it never sent one.
+string GetUserNameFromPeer(ENetPeer* peer)
+{
+    PlayerId player = players.Find(peer);
+
+    if (player != invalidPlayerId)
+    {
+        return string(players.GetUsername(player));
+    }
+
+    return "";
+}
+
+float GetWinRate(const string& username)
+{
+    auto iterator = winRateByUsername.find(username);
+
+    return iterator != winRateByUsername.end() ? iterator->second : 0.5f;
+}
+
+// Hand a packet to the I/O thread. Blocks only if the I/O thread has fallen a full ring behind.
+void PushOutboundPacket(const OutboundPacket& outboundPacket)
+{
+    while (!outboundPackets.TryPush(outboundPacket))
+    {
+        std::this_thread::yield();
+    }
+}
+
+// The connection a record for peer is meant for, or 0 to send to whoever has the peer (non-players).
+uint32_t GetPlayerConnectId(ENetPeer* peer)
+{
+    PlayerId player = players.Find(peer);
+
+    return player != invalidPlayerId ? players.connectIds[player] : 0;
+}
+
+// Queue one record for a packet, holding a reference until the I/O thread has handed it to ENet.
+void PushPacket(ENetPeer* peer, ENetPacket* packet)
+{
+    packet->referenceCount++;
+
+    OutboundPacket outboundPacket;
+    outboundPacket.peer = peer;
+    outboundPacket.connectId = peer ? GetPlayerConnectId(peer) : 0;
+    outboundPacket.packet = packet;
+    outboundPacket.releasePacket = true;
+
+    PushOutboundPacket(outboundPacket);
+}
+
+// Send a packet to one peer, or to every peer on the host if peer is null.
+void QueueOutboundPacket(ENetPeer* peer, ENetPacket* packet)
+{
+    // batched messages were sent first, so they have to arrive first
+    if (peer)
+    {
+        FlushMessageBatch(peer);
+    }
+    else
+    {
+        FlushMessageBatches();
+    }
+
+    PushPacket(peer, packet);
+}
+
+// Send one packet to several peers. Only the last record releases our hold on it,
+// so the packet outlives however many I/O ticks it takes to reach everyone.
+void QueueSharedPacket(const PlayerId* recipients, size_t count, ENetPacket* packet)
+{
+    if (count == 0)
+    {
+        enet_packet_destroy(packet);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        FlushPlayerMessageBatch(recipients[i]);
+    }
+
+    packet->referenceCount++;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        OutboundPacket outboundPacket;
+        outboundPacket.peer = players.peers[recipients[i]];
+        outboundPacket.connectId = players.connectIds[recipients[i]];
+        outboundPacket.packet = packet;
+        outboundPacket.releasePacket = i + 1 == count;
+
+        PushOutboundPacket(outboundPacket);
+    }
+}
+
+int GetTopicIndex(SubscriptionTopic topic)
+{
+    int index = 0;
+
+    while (index < (int)subscriptionTopicCount - 1 && !(topic & (1 << index)))
+    {
+        index++;
+    }
+
+    return index;
+}
+
+void ClearSubscribers(TopicSubscribers& subscribers)
+{
+    subscribers.players.clear();
+    subscribers.batchingCount = 0;
+}
+
+// Batching players go in front of the rest, so both halves stay contiguous.
+void AddSubscriber(TopicSubscribers& subscribers, PlayerId player)
+{
+    subscribers.players.push_back(player);
+
+    if (players.flags[player] & PF_MessageBatching)
+    {
+        swap(subscribers.players[subscribers.batchingCount], subscribers.players.back());
+        subscribers.batchingCount++;
+    }
+}
+
+// Everyone in the room subscribed to topic, rebuilding the room's lists first if its players changed.
+const TopicSubscribers& GetRoomSubscribers(Room& room, SubscriptionTopic topic)
+{
+    if (room.subscribersDirty)
+    {
+        for (size_t index = 0; index < subscriptionTopicCount; index++)
+        {
+            ClearSubscribers(room.subscribers[index]);
+        }
+
+        for (ENetPeer* peer : room.members)
+        {
+            PlayerId player = players.Find(peer);
+
+            if (player == invalidPlayerId)
+            {
+                continue;
+            }
+
+            for (size_t index = 0; index < subscriptionTopicCount; index++)
+            {
+                if (players.subscriptionTopics[player] & (1 << index))
+                {
+                    AddSubscriber(room.subscribers[index], player);
+                }
+            }
+        }
+
+        room.subscribersDirty = false;
+    }
+
+    return room.subscribers[GetTopicIndex(topic)];
+}
+
+// Every player subscribed to ST_Server. Peers that never sent UserInfo aren't players yet.
+const TopicSubscribers& GetServerSubscribers()
+{
+    if (serverSubscribersDirty)
+    {
+        ClearSubscribers(serverSubscribers);
+
+        for (PlayerId player = 0; player < players.Capacity(); player++)
+        {
+            if (players.peers[player] && (players.subscriptionTopics[player] & ST_Server))
+            {
+                AddSubscriber(serverSubscribers, player);
+            }
+        }
+
+        serverSubscribersDirty = false;
+    }
+
+    return serverSubscribers;
+}
+
+// The player's room and the server lists have to be rebuilt after anything about a player changes.
+void MarkSubscribersDirty(int roomId)
+{
+    serverSubscribersDirty = true;
+
+    auto roomIterator = rooms.find(roomId);
+
+    if (roomIterator != rooms.end())
+    {
+        roomIterator->second.subscribersDirty = true;
+    }
+}
+
+// Send one packet to every player in a room subscribed to topic.
+void QueueRoomPacket(Room& room, SubscriptionTopic topic, ENetPacket* packet)
+{
+    const TopicSubscribers& subscribers = GetRoomSubscribers(room, topic);
+
+    QueueSharedPacket(subscribers.players.data(), subscribers.players.size(), packet);
+}
+
+// Ask the I/O thread to disconnect a peer once everything queued for it has been sent.
+void QueueDisconnect(ENetPeer* peer)
+{
+    FlushMessageBatch(peer);
+
+    OutboundPacket outboundPacket;
+    outboundPacket.peer = peer;
+    outboundPacket.connectId = GetPlayerConnectId(peer);
+    outboundPacket.disconnect = true;
+
+    PushOutboundPacket(outboundPacket);
+}
+
+void QueueMessageBatchPacket(PlayerId player)
+{
+    ENetPacket* packet = enet_packet_create(messageBatchBuffer.data(),
+        messageBatchBuffer.size(),
+        ENET_PACKET_FLAG_RELIABLE);
+
+    packet->referenceCount++;
+
+    OutboundPacket outboundPacket;
+    outboundPacket.peer = players.peers[player];
+    outboundPacket.connectId = players.connectIds[player];
+    outboundPacket.packet = packet;
+    outboundPacket.releasePacket = true;
+
+    PushOutboundPacket(outboundPacket);
+}
+
+// Send everything batched for one player, split so each packet stays around one datagram.
+void FlushPlayerMessageBatch(PlayerId player)
+{
+    if (!players.peers[player] || players.firstPendingMessages[player] == noPendingMessage)
+    {
+        return;
+    }
+
+    MessageBatchGamePacket::begin(messageBatchBuffer);
+
+    for (uint32_t index = players.firstPendingMessages[player]; index != noPendingMessage; index = pendingMessages[index].next)
+    {
+        string_view message(&pendingMessageText[pendingMessages[index].offset], pendingMessages[index].length);
+        size_t count = MessageBatchGamePacket::count(messageBatchBuffer);
+
+        if (count == maxMessagesPerBatch || (count > 0 && messageBatchBuffer.size() + message.size() > maxMessageBatchSize))
+        {
+            QueueMessageBatchPacket(player);
+            MessageBatchGamePacket::begin(messageBatchBuffer);
+        }
+
+        if (!MessageBatchGamePacket::append(messageBatchBuffer, message, players.messageEncoders[player], players.strings, encodedMessageBuffer))
+        {
+            // too long to batch; everything batched before it has just been queued, so it still arrives in order
+            PushPacket(players.peers[player], CreateMessagePacket(string(message)));
+        }
+    }
+
+    if (MessageBatchGamePacket::count(messageBatchBuffer) > 0)
+    {
+        QueueMessageBatchPacket(player);
+    }
+
+    players.firstPendingMessages[player] = noPendingMessage;
+    players.lastPendingMessages[player] = noPendingMessage;
+}
+
+void FlushMessageBatch(ENetPeer* peer)
+{
+    PlayerId player = players.Find(peer);
+
+    if (player != invalidPlayerId)
+    {
+        FlushPlayerMessageBatch(player);
+    }
+}
+
+// Called at the end of every logic tick. Every chain is empty afterwards, so the pool starts over.
+void FlushMessageBatches()
+{
+    for (PlayerId player : playersWithPendingMessages)
+    {
+        FlushPlayerMessageBatch(player);
+    }
+
+    playersWithPendingMessages.clear();
+    pendingMessages.clear();
+    pendingMessageText.clear();
+}
+
+// Store a message's text for this tick's batches, returning its offset.
+uint32_t AddPendingMessageText(const string& message)
+{
+    uint32_t offset = (uint32_t)pendingMessageText.size();
+    pendingMessageText += message;
+
+    return offset;
+}
+
+void AddPendingMessage(PlayerId player, uint32_t offset, uint32_t length)
+{
+    uint32_t index = (uint32_t)pendingMessages.size();
+    pendingMessages.push_back({ offset, length, noPendingMessage });
+
+    if (players.firstPendingMessages[player] == noPendingMessage)
+    {
+        players.firstPendingMessages[player] = index;
+        playersWithPendingMessages.push_back(player);
+    }
+    else
+    {
+        pendingMessages[players.lastPendingMessages[player]].next = index;
+    }
+
+    players.lastPendingMessages[player] = index;
+}
+
+ENetPacket* CreateMessagePacket(const string& message)
+{
+    MessageGamePacket messageGP;
+    messageGP.message = message;
+
+    size_t dataSize = messageGP.size();
+    char* data = new char[dataSize];
+
+    MessageGamePacket::serialize(messageGP, data);
+
+    /* Create a reliable packet of size 7 containing "packet\0" */
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    return packet;
+}
+
+void BroadcastMessage(const TopicSubscribers& subscribers, const string& message)
+{
+    if (subscribers.batchingCount > 0)
+    {
+        uint32_t offset = AddPendingMessageText(message);
+
+        for (size_t i = 0; i < subscribers.batchingCount; i++)
+        {
+            AddPendingMessage(subscribers.players[i], offset, (uint32_t)message.size());
+        }
+    }
+
+    // clients without batching all share one plain message packet
+    size_t plainCount = subscribers.players.size() - subscribers.batchingCount;
+
+    if (plainCount > 0)
+    {
+        QueueSharedPacket(subscribers.players.data() + subscribers.batchingCount, plainCount, CreateMessagePacket(message));
+    }
+}
+
+// Send a message to everyone in a room subscribed to topic.
+void BroadcastMessage(Room& room, SubscriptionTopic topic, string message)
+{
+    BroadcastMessage(GetRoomSubscribers(room, topic), message);
+}
+
+// Send a message to every player subscribed to server notices, in a room or not.
+void BroadcastMessageToAll(string message)
+{
+    BroadcastMessage(GetServerSubscribers(), message);
+}
+
+// Send a message to a single peer.
+void SendMessageToPeer(ENetPeer* peer, string message)
+{
+    PlayerId player = players.Find(peer);
+
+    if (player != invalidPlayerId && (players.flags[player] & PF_MessageBatching))
+    {
+        AddPendingMessage(player, AddPendingMessageText(message), (uint32_t)message.size());
+        return;
+    }
+
+    QueueOutboundPacket(peer, CreateMessagePacket(message));
+}
+
+// Tell everyone in the room whether the number is higher or lower than a guess.
+void BroadcastGuessResult(Room& room, int guess, GuessHint hint)
+{
+    GuessResultGamePacket guessResultGP;
+    guessResultGP.guess = guess;
+    guessResultGP.hint = hint;
+    guessResultGP.low = room.guessTracker.low;
+    guessResultGP.high = room.guessTracker.high;
+
+    size_t dataSize = guessResultGP.size();
+    char* data = new char[dataSize];
+
+    GuessResultGamePacket::serialize(guessResultGP, data);
+
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    QueueRoomPacket(room, ST_Results, packet);
+}
+
+int GetRandomNumber(int max)
+{
+    /* generate secret number between 1 and max (seeded once in main): */
+    return rand() % max + 1;
+}
+
+// Sends a packet to the active peer and requests input.
+void SendInputPromptToActivePeer(Room& room)
+{
+    room.turnDeadline = chrono::steady_clock::now() + chrono::milliseconds(serverConfig.turnTimeout);
+
+    // send to player it's their turn, stamped so the client can count down and measure delivery
+    UserGuessGamePacket userGuessGP;
+    userGuessGP.number = room.maxNumber;
+    userGuessGP.serverSendTime = GetClockMicroseconds();
+    userGuessGP.deadline = userGuessGP.serverSendTime + (int64_t)serverConfig.turnTimeout * 1000;
+
+    size_t dataSize = userGuessGP.size();
+    char* data = new char[dataSize];
+
+    UserGuessGamePacket::serialize(userGuessGP, data);
+
+    /* Create a reliable packet of size 7 containing "packet\0" */
+    ENetPacket* packet = enet_packet_create(data,
+        dataSize,
+        ENET_PACKET_FLAG_RELIABLE);
+
+    delete[] data;
+
+    QueueOutboundPacket(room.activePeer, packet);
+}
+
+void SendTurnToActivePeer(Room& room)
+{
+    BroadcastMessage(room, ST_Turns, "System Message: It is now " + GetUserNameFromPeer(room.activePeer) + "'s turn.");
+    SendInputPromptToActivePeer(room);
+}
+
+// Given the active peer, get the next peer in "line" for a turn.
+ENetPeer* GetNextPeer(Room& room)
+{
+    if (room.members.size() == 0)
+    {
+        return nullptr;
+    }
+
+    auto it = find(room.members.begin(), room.members.end(), room.activePeer);
+
+    // no currently set active peer, or it was the last one? back to the first
+    if (it == room.members.end() || ++it == room.members.end())
+    {
+        return room.members.front();
+    }
+
+    return *it;
+}
+
+void AssignNextPeer(Room& room)
+{
+    room.activePeer = GetNextPeer(room);
+}
+
+void BeginGame(Room& room)
+{
+    WriteLocalMessage("Beginning game in room " + to_string(room.id) + ".");
+
+    // a reloaded maxNumber only ever applies to whole rounds
+    room.maxNumber = serverConfig.maxNumber;
+    room.numberToGuess = GetRandomNumber(room.maxNumber);
+    room.guessTracker.Reset(room.maxNumber);
+    room.checkpointDirty = true;
+
+    WriteLocalMessage("Number to guess in room " + to_string(room.id) + ": " + to_string(room.numberToGuess));
+
+    BroadcastMessage(room, ST_Room, "System Message: Starting new game. ("
+        + to_string(room.members.size()) + " players)"
+        + "\nMinimum guess: 1, Maximum: " + to_string(room.maxNumber));
+
+    AssignNextPeer(room);
+
+    room.gameStarted = true;
+}
+
+// Returns current time from epoch in seconds.
+uint32_t GetTime()
+{
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+}
+
+// Reset variables. The next round starts after timeToWaitForNextGame (see RunRoom).
+void EndGame(Room& room)
+{
+    WriteLocalMessage("Game is over in room " + to_string(room.id) + ".");
+
+    room.gameStarted = false;
+    room.activePeer = nullptr;
+    room.numberToGuess = 0;
+    room.checkpointDirty = true;
+}
+
+bool IsCorrectGuess(Room& room, int guess)
+{
+    return guess == room.numberToGuess;
+}
+
+// Score the active player's guess and tell the room. Returns whether it was right.
+bool HandleGuess(Room& room, int guess)
+{
+    GuessHint hint = room.guessTracker.RecordGuess(guess, room.numberToGuess);
+    BroadcastGuessResult(room, guess, hint);
+    room.checkpointDirty = true;
+
+    if (!IsCorrectGuess(room, guess))
+    {
+        BroadcastMessage(room, ST_Results, "System Message: Incorrect number guessed (" + to_string(guess) +
+            ") by " + GetUserNameFromPeer(room.activePeer) + ".");
+
+        return false;
+    }
+
+    BroadcastMessage(room, ST_Results, "System Message: Correct number guessed (" + to_string(guess) +
+        ") by " + GetUserNameFromPeer(room.activePeer) + ". They are the winner!");
+
+    RecordRoundResult(room, room.activePeer);
+
+    if (analyticsEnabled)
+    {
+        WriteRoundAnalytics(room);
+        WriteMemoryUsage(room);
+    }
+
+    return true;
+}
+
+// Fold the round into every player's recent win rate.
+void RecordRoundResult(Room& room, ENetPeer* winner)
+{
+    for (ENetPeer* peer : room.members)
+    {
+        string username = GetUserNameFromPeer(peer);
+        float won = peer == winner ? 1.0f : 0.0f;
+        float winRate = GetWinRate(username);
+
+        winRateByUsername[username] = winRate + (won - winRate) * winRateSmoothing;
+    }
+}
+
+// Score the round that just finished against optimal play. Duplicates and out of range guesses were
+// already counted as they came in.
+void WriteRoundAnalytics(Room& room)
+{
+    vector<GuessStreamScore> scores = ScoreGuessStreams({ &room.guessTracker.history }, { room.numberToGuess }, room.maxNumber);
+    const GuessStreamScore& score = scores[0];
+
+    WriteLocalMessage("Round analytics (room " + to_string(room.id) + "): " + to_string(score.guesses)
+        + " guesses (binary search worst case " + to_string(score.optimalGuesses) + "), distance from optimal "
+        + to_string(score.distanceFromOptimal) + ", duplicates " + to_string(room.guessTracker.duplicateGuesses)
+        + ", out of range " + to_string(room.guessTracker.outOfRangeGuesses) + ".");
+}
+
+// Bytes a room holds, counting its players' share of the players arena.
+size_t GetRoomMemoryUsage(const Room& room)
+{
+    size_t usage = sizeof(Room) + room.members.capacity() * sizeof(ENetPeer*)
+        + room.guessTracker.history.capacity() * sizeof(int) + room.guessTracker.guessed.MemoryUsage();
+
+    for (const TopicSubscribers& subscribers : room.subscribers)
+    {
+        usage += subscribers.players.capacity() * sizeof(PlayerId);
+    }
+
+    for (const string& username : room.resumingUsernames)
+    {
+        usage += sizeof(string) + username.capacity();
+    }
+
+    if (players.Capacity() > 0)
+    {
+        usage += room.members.size() * (players.MemoryUsage() / players.Capacity());
+    }
+
+    return usage;
+}
+
+void WriteMemoryUsage(const Room& room)
+{
+    size_t roomUsage = GetRoomMemoryUsage(room);
+
+    WriteLocalMessage("Memory (room " + to_string(room.id) + "): " + to_string(roomUsage) + " bytes, "
+        + to_string(room.members.empty() ? 0 : roomUsage / room.members.size()) + " per player. All "
+        + to_string(players.Size()) + " players: " + to_string(players.MemoryUsage()) + " bytes.");
+}
+
+Room& CreateRoom(const vector<LobbyEntry>& members)
+{
+    Room& room = rooms[nextRoomId];
+    room.id = nextRoomId++;
+
+    string names = "";
+
+    for (const LobbyEntry& member : members)
+    {
+        PlayerId player = players.Find(member.peer);
+
+        room.members.push_back(member.peer);
+        players.roomIds[player] = room.id;
+
+        names += (names.empty() ? "" : ", ") + string(players.GetUsername(player));
+    }
+
+    WriteLocalMessage("Room " + to_string(room.id) + " created with " + to_string(members.size())
+        + " players. Lobby: " + to_string(lobby.Size()));
+
+    BroadcastMessage(room, ST_Room, "System Message: Joined room " + to_string(room.id) + " with " + names + ".");
+
+    return room;
+}
+
+// Send everyone in a room back to the lobby. The room itself goes once its lifecycle returns.
+void CloseRoom(Room& room)
+{
+    auto now = chrono::steady_clock::now();
+
+    for (ENetPeer* peer : room.members)
+    {
+        PlayerId player = players.Find(peer);
+        players.roomIds[player] = 0;
+
+        LobbyEntry lobbyEntry;
+        lobbyEntry.peer = peer;
+        lobbyEntry.roundTripTime = players.roundTripTimes[player];
+        lobbyEntry.winRate = GetWinRate(string(players.GetUsername(player)));
+        lobbyEntry.enqueueTime = now;
+
+        lobby.Enqueue(lobbyEntry);
+    }
+
+    WriteLocalMessage("Room " + to_string(room.id) + " closed.");
+}
+
+// Remove a room along with its checkpoint and anyone still expected back in it.
+void EraseRoom(int roomId)
+{
+    auto roomIterator = rooms.find(roomId);
+
+    if (roomIterator == rooms.end())
+    {
+        return;
+    }
+
+    for (const string& username : roomIterator->second.resumingUsernames)
+    {
+        auto resumingIterator = resumingPlayers.find(username);
+
+        if (resumingIterator != resumingPlayers.end() && resumingIterator->second == roomId)
+        {
+            resumingPlayers.erase(resumingIterator);
+        }
+    }
+
+    if (roomIterator->second.checkpointSlot >= 0)
+    {
+        roomCheckpoint.FreeSlot(roomIterator->second.checkpointSlot);
+    }
+
+    rooms.erase(roomIterator);
+}
+
+// Form as many rooms as the lobby can fill right now.
+void UpdateLobby(chrono::steady_clock::time_point now)
+{
+    if (drainRequested)
+    {
+        return;
+    }
+
+    vector<LobbyEntry> members;
+
+    while (lobby.TryFormRoom(now, (size_t)serverConfig.roomSize, (size_t)requiredNumberOfPlayersToBegin,
+        chrono::milliseconds(serverConfig.lobbyTimeout), members))
+    {
+        StartRoom(CreateRoom(members));
+    }
+}
+
+RoomTask::Awaiter WaitForRoomEvent(Room& room, chrono::steady_clock::time_point deadline, uint8_t wantedEvents)
+{
+    return RoomTask::Awaiter{ roomTimers, room.id, deadline, wantedEvents };
+}
+
+// One room from start to finish: rounds back to back until too few players are left.
+RoomTask RunRoom(Room& room)
+{
+    // restored from a checkpoint: wait for the players, or just for whoever's turn it was
+    while (!room.resumingUsernames.empty() && !room.activePeer)
+    {
+        RoomEvent event = co_await WaitForRoomEvent(room, room.resumeDeadline, RE_PlayerResumed);
+
+        if (event.type == RE_Timeout)
+        {
+            FinishResume(room);
+        }
+    }
+
+    if (room.members.empty())
+    {
+        WriteLocalMessage("Nobody came back to room " + to_string(room.id) + ".");
+        co_return;
+    }
+
+    while (true)
+    {
+        // a restored room may already be mid-round
+        if (!room.gameStarted)
+        {
+            // no new rounds while draining; the server stops before this wait would end
+            if (drainRequested)
+            {
+                co_await WaitForRoomEvent(room, chrono::steady_clock::time_point::max(), 0);
+            }
+
+            if ((int)room.members.size() < requiredNumberOfPlayersToBegin)
+            {
+                BroadcastMessage(room, ST_Room, "System Message: Not enough players left in this room, returning to the lobby.");
+                CloseRoom(room);
+                co_return;
+            }
+
+            BeginGame(room);
+        }
+
+        while (room.gameStarted)
+        {
+            if (!room.activePeer)
+            {
+                AssignNextPeer(room);
+            }
+
+            // everyone here left
+            if (!room.activePeer)
+            {
+                // players of a restored room may still come back
+                if (!room.resumingUsernames.empty())
+                {
+                    RoomEvent event = co_await WaitForRoomEvent(room, room.resumeDeadline, RE_PlayerResumed);
+
+                    if (event.type != RE_Timeout)
+                    {
+                        continue;
+                    }
+
+                    FinishResume(room);
+                }
+
+                WriteLocalMessage("Nobody is left in room " + to_string(room.id) + ".");
+                co_return;
+            }
+
+            SendTurnToActivePeer(room);
+
+            // the turn can outlast the wait for a restored room's players, which ends along the way
+            RoomEvent event;
+
+            do
+            {
+                bool resuming = !room.resumingUsernames.empty();
+                auto deadline = resuming ? min(room.turnDeadline, room.resumeDeadline) : room.turnDeadline;
+
+                event = co_await WaitForRoomEvent(room, deadline, RE_Guess | RE_ActivePlayerLeft);
+
+                if (event.type == RE_Timeout && resuming && event.time >= room.resumeDeadline)
+                {
+                    FinishResume(room);
+                }
+            } while (event.type == RE_Timeout && event.time < room.turnDeadline);
+
+            if (event.type == RE_Guess)
+            {
+                if (HandleGuess(room, event.number))
+                {
+                    EndGame(room);
+                }
+                else
+                {
+                    AssignNextPeer(room);
+                }
+            }
+            else if (event.type == RE_Timeout)
+            {
+                BroadcastMessage(room, ST_Turns, "System Message: " + GetUserNameFromPeer(room.activePeer) + " ran out of time.");
+                AssignNextPeer(room);
+            }
+
+            // RE_ActivePlayerLeft: HandleDisconnectCommand already passed the turn on
+        }
+
+        co_await WaitForRoomEvent(room, chrono::steady_clock::now() + chrono::milliseconds(timeToWaitForNextGame), 0);
+    }
+}
+
+// Run a new or restored room's lifecycle up to its first wait.
+void StartRoom(Room& room)
+{
+    room.lifecycle = RunRoom(room);
+
+    if (room.lifecycle.IsDone())
+    {
+        EraseRoom(room.id);
+    }
+}
+
+// Hand the room's lifecycle an event. It might finish, and the room with it.
+void ResumeRoom(Room& room, const RoomEvent& event)
+{
+    if (room.lifecycle.Post(event) && room.lifecycle.IsDone())
+    {
+        EraseRoom(room.id);
+    }
+}
+
+// Hand a room an event from a command. Dropped unless the room is waiting for one like it.
+void PostRoomEvent(Room& room, RoomEventType type, int number)
+{
+    RoomEvent event;
+    event.type = type;
+    event.number = number;
+    event.time = chrono::steady_clock::now();
+
+    ResumeRoom(room, event);
+}
+
+// Wake every room whose wait has run out. Waits that start meanwhile are left for the next tick,
+// even if they're already due, so a room can't keep the loop here.
+void UpdateRoomTimers(chrono::steady_clock::time_point now)
+{
+    dueRoomTimers.clear();
+
+    while (!roomTimers.empty() && roomTimers.top().time <= now)
+    {
+        dueRoomTimers.push_back(roomTimers.top());
+        roomTimers.pop();
+    }
+
+    for (const RoomTimer& timer : dueRoomTimers)
+    {
+        auto roomIterator = rooms.find(timer.roomId);
+
+        // the room is gone, or an event ended that wait already
+        if (roomIterator == rooms.end() || !roomIterator->second.lifecycle.IsCurrentWait(timer.wait))
+        {
+            continue;
+        }
+
+        RoomEvent event;
+        event.type = RE_Timeout;
+        event.time = now;
+
+        ResumeRoom(roomIterator->second, event);
+    }
+}
+
+void SnapshotRoom(const Room& room, RoomSnapshot& snapshot)
+{
+    snapshot = RoomSnapshot();
+    snapshot.roomId = room.id;
+    snapshot.maxNumber = room.maxNumber;
+    snapshot.numberToGuess = room.numberToGuess;
+    snapshot.low = room.guessTracker.low;
+    snapshot.high = room.guessTracker.high;
+    snapshot.gameStarted = room.gameStarted ? 1 : 0;
+
+    auto addPlayer = [&snapshot](string_view username, bool active) {
+        if (snapshot.playerCount == maxSnapshotPlayers) return;
+        if (active) snapshot.activePlayer = snapshot.playerCount;
+
+        username.copy(snapshot.usernames[snapshot.playerCount], maxUsernameLength);
+        snapshot.playerCount++;
+    };
+
+    for (ENetPeer* peer : room.members)
+    {
+        addPlayer(players.GetUsername(players.Find(peer)), peer == room.activePeer);
+    }
+
+    // players still expected back after an earlier restore are part of the room too
+    for (const string& username : room.resumingUsernames)
+    {
+        addPlayer(username, !room.activePeer && username == room.resumeActiveUsername);
+    }
+}
+
+// Rebuild a room from a snapshot, empty until its players reconnect.
+Room& RestoreRoom(const RoomSnapshot& snapshot)
+{
+    // a snapshot from another process can clash with a room here
+    int roomId = snapshot.roomId > 0 && !rooms.count(snapshot.roomId) ? snapshot.roomId : nextRoomId;
+    nextRoomId = max(nextRoomId, roomId + 1);
+
+    auto now = chrono::steady_clock::now();
+
+    Room& room = rooms[roomId];
+    room.id = roomId;
+    room.maxNumber = max(snapshot.maxNumber, 1);
+    room.numberToGuess = snapshot.numberToGuess;
+    room.guessTracker.Reset(room.maxNumber);
+    room.guessTracker.low = snapshot.low;
+    room.guessTracker.high = snapshot.high;
+    room.gameStarted = snapshot.gameStarted != 0;
+    room.resumeDeadline = now + chrono::milliseconds(serverConfig.resumeTimeout);
+    room.checkpointDirty = true;
+
+    for (size_t i = 0; i < snapshot.playerCount && i < maxSnapshotPlayers; i++)
+    {
+        string username(snapshot.usernames[i], strnlen(snapshot.usernames[i], maxUsernameLength + 1));
+
+        room.resumingUsernames.push_back(username);
+        resumingPlayers[username] = roomId;
+
+        if (i == snapshot.activePlayer)
+        {
+            room.resumeActiveUsername = username;
+        }
+    }
+
+    return room;
+}
+
+// Load every room in a checkpoint file, this server's own or another's.
+bool RestoreRooms(const string& path, string& error)
+{
+    RoomCheckpointFile checkpoint;
+
+    if (!checkpoint.Open(path, false, error))
+    {
+        return false;
+    }
+
+    for (const RoomSnapshot& snapshot : checkpoint.ReadSnapshots())
+    {
+        Room& room = RestoreRoom(snapshot);
+
+        WriteLocalMessage("Restored room " + to_string(room.id) + ", waiting for "
+            + to_string(room.resumingUsernames.size()) + " players.");
+
+        StartRoom(room);
+    }
+
+    return true;
+}
+
+// Start checkpointing to path. Whatever the file held is discarded; restore from it first.
+bool OpenRoomCheckpoint(const string& path, string& error)
+{
+    if (!roomCheckpoint.Open(path, true, error))
+    {
+        return false;
+    }
+
+    roomCheckpoint.Reset();
+
+    for (auto& entry : rooms)
+    {
+        entry.second.checkpointSlot = -1;
+        entry.second.checkpointDirty = true;
+    }
+
+    return true;
+}
+
+// A clean shutdown leaves nothing to restore.
+void CloseRoomCheckpoint()
+{
+    if (roomCheckpoint.IsOpen())
+    {
+        roomCheckpoint.Reset();
+        roomCheckpoint.Close();
+    }
+}
+
+// Write every room that changed since the last checkpoint.
+void UpdateCheckpoint(chrono::steady_clock::time_point now)
+{
+    if (!roomCheckpoint.IsOpen() || now < nextCheckpointTime)
+    {
+        return;
+    }
+
+    nextCheckpointTime = now + chrono::milliseconds(serverConfig.checkpointInterval);
+
+    RoomSnapshot snapshot;
+    bool wroteRoom = false;
+
+    for (auto& entry : rooms)
+    {
+        Room& room = entry.second;
+
+        if (!room.checkpointDirty)
+        {
+            continue;
+        }
+
+        if (room.checkpointSlot < 0)
+        {
+            room.checkpointSlot = roomCheckpoint.AllocateSlot();
+        }
+
+        // out of disk, try again next time
+        if (room.checkpointSlot < 0)
+        {
+            continue;
+        }
+
+        SnapshotRoom(room, snapshot);
+        roomCheckpoint.WriteSlot(room.checkpointSlot, snapshot);
+
+        room.checkpointDirty = false;
+        wroteRoom = true;
+    }
+
+    if (wroteRoom)
+    {
+        roomCheckpoint.Flush();
+    }
+}
+
+// Put a reconnecting player back into the restored room they were in.
+bool ResumePlayer(PlayerId player)
+{
+    string username(players.GetUsername(player));
+    ENetPeer* peer = players.peers[player];
+
+    auto resumingIterator = resumingPlayers.find(username);
+
+    if (resumingIterator == resumingPlayers.end())
+    {
+        return false;
+    }
+
+    int roomId = resumingIterator->second;
+    resumingPlayers.erase(resumingIterator);
+
+    auto roomIterator = rooms.find(roomId);
+
+    if (roomIterator == rooms.end())
+    {
+        return false;
+    }
+
+    Room& room = roomIterator->second;
+
+    room.resumingUsernames.erase(find(room.resumingUsernames.begin(), room.resumingUsernames.end(), username));
+    room.members.push_back(peer);
+    room.checkpointDirty = true;
+    room.subscribersDirty = true;
+    players.roomIds[player] = roomId;
+
+    WriteLocalMessage(username + " resumed room " + to_string(roomId) + ".");
+
+    BroadcastMessage(room, ST_JoinLeave, "System Message: " + username + " is back in room " + to_string(roomId) + ".");
+
+    // their turn carries on
+    if (room.gameStarted && !room.activePeer && username == room.resumeActiveUsername)
+    {
+        room.activePeer = peer;
+    }
+
+    if (room.resumingUsernames.empty())
+    {
+        FinishResume(room);
+    }
+
+    PostRoomEvent(room, RE_PlayerResumed);
+
+    return true;
+}
+
+// Stop waiting for a restored room's missing players. RunRoom carries on with whoever is back.
+void FinishResume(Room& room)
+{
+    for (const string& username : room.resumingUsernames)
+    {
+        resumingPlayers.erase(username);
+    }
+
+    room.resumingUsernames.clear();
+    room.resumeActiveUsername = "";
+    room.checkpointDirty = true;
+}
+
+void HandleUserInfoCommand(const GameCommand& command)
+{
+    string username = command.username;
+
+    if (drainRequested)
+    {
+        SendMessageToPeer(command.peer, "System Message: The server is shutting down. Please try again later.");
+        QueueDisconnect(command.peer);
+        return;
+    }
+
+    PlayerId player = players.Add(command.peer, command.connectId, username);
+
+    // already joined
+    if (player == invalidPlayerId)
+    {
+        return;
+    }
+
+    players.roundTripTimes[player] = command.roundTripTime;
+    players.flags[player] = (command.userInfoFlags & UIF_MessageBatch) ? PF_MessageBatching : 0;
+    serverSubscribersDirty = true;
+
+    LobbyEntry lobbyEntry;
+    lobbyEntry.peer = command.peer;
+    lobbyEntry.roundTripTime = command.roundTripTime;
+    lobbyEntry.winRate = GetWinRate(username);
+    lobbyEntry.enqueueTime = chrono::steady_clock::now();
+
+    // back from before a restart
+    if (ResumePlayer(player))
+    {
+        return;
+    }
+
+    lobby.Enqueue(lobbyEntry);
+
+    SendMessageToPeer(command.peer, "System Message: Welcome " + username + ". Finding you a room... ("
+        + to_string(lobby.Size()) + " waiting)");
+}
+
+void HandleUserGuessCommand(const GameCommand& command)
+{
+    PlayerId player = players.Find(command.peer, command.connectId);
+
+    if (player == invalidPlayerId || players.roomIds[player] == 0)
+    {
+        return;
+    }
+
+    auto roomIterator = rooms.find(players.roomIds[player]);
+
+    if (roomIterator == rooms.end())
+    {
+        return;
+    }
+
+    Room& room = roomIterator->second;
+
+    if (room.activePeer != nullptr && command.peer == room.activePeer)
+    {
+        PostRoomEvent(room, RE_Guess, command.number);
+    }
+}
+
+void HandleSubscribeCommand(const GameCommand& command)
+{
+    PlayerId player = players.Find(command.peer, command.connectId);
+
+    if (player == invalidPlayerId)
+    {
+        return;
+    }
+
+    players.subscriptionTopics[player] = command.subscriptionTopics & ST_All;
+    MarkSubscribersDirty(players.roomIds[player]);
+}
+
+void HandleDisconnectCommand(const GameCommand& command)
+{
+    PlayerId player = players.Find(command.peer, command.connectId);
+
+    // never sent UserInfo
+    if (player == invalidPlayerId)
+    {
+        return;
+    }
+
+    string leftPlayerName(players.GetUsername(player));
+    int roomId = players.roomIds[player];
+
+    players.Remove(player);
+    serverSubscribersDirty = true;
+
+    if (roomId == 0)
+    {
+        lobby.Remove(command.peer);
+        return;
+    }
+
+    auto roomIterator = rooms.find(roomId);
+
+    if (roomIterator == rooms.end())
+    {
+        return;
+    }
+
+    Room& room = roomIterator->second;
+    auto member = find(room.members.begin(), room.members.end(), command.peer);
+
+    if (member == room.members.end())
+    {
+        return;
+    }
+
+    // work out whose turn is next while the leaving player is still in the rotation
+    bool wasActivePeer = command.peer == room.activePeer;
+    ENetPeer* nextPeer = wasActivePeer ? GetNextPeer(room) : room.activePeer;
+
+    room.members.erase(member);
+    room.checkpointDirty = true;
+    room.subscribersDirty = true;
+
+    // a restored room still waiting on other players stays open for them
+    if (room.members.empty() && room.resumingUsernames.empty())
+    {
+        WriteLocalMessage("Room " + to_string(roomId) + " is empty.");
+        EraseRoom(roomId);
+        return;
+    }
+
+    BroadcastMessage(room, ST_JoinLeave, "System Message: " + leftPlayerName + " has left the game.");
+
+    if (wasActivePeer)
+    {
+        WriteLocalMessage("Active peer (" + leftPlayerName + ") has left.");
+
+        room.activePeer = nextPeer != command.peer ? nextPeer : nullptr;
+
+        if (room.activePeer && room.gameStarted)
+        {
+            WriteLocalMessage("New active peer (" + GetUserNameFromPeer(room.activePeer) + ")");
+        }
+
+        PostRoomEvent(room, RE_ActivePlayerLeft);
+    }
+}
+
+// Re-read the config file. maxNumber waits for the next round, everything else applies now.
+void ReloadServerConfig()
+{
+    string error;
+
+    if (!LoadServerConfig(serverConfigPath, serverConfig, error))
+    {
+        WriteLocalMessage("Config not reloaded: " + error);
+        return;
+    }
+
+    ApplyServerConfig();
+
+    WriteLocalMessage("Config loaded from " + serverConfigPath + ".");
+}
+
+// Copy the settings that also live in their own globals out of serverConfig.
+void ApplyServerConfig()
+{
+    requiredNumberOfPlayersToBegin = serverConfig.requiredNumberOfPlayersToBegin;
+    timeToWaitForNextGame = serverConfig.timeToWaitForNextGame;
+    drainTimeout = serverConfig.drainTimeout;
+}
+
+// Once a drain is requested, let the current rounds finish and then report drained.
+void UpdateDrain()
+{
+    if (!drainRequested || gameLogicDrained)
+    {
+        return;
+    }
+
+    bool roundInProgress = false;
+
+    for (auto& entry : rooms)
+    {
+        roundInProgress = roundInProgress || entry.second.gameStarted;
+    }
+
+    if (!drainAnnounced)
+    {
+        drainAnnounced = true;
+
+        if (roundInProgress)
+        {
+            BroadcastMessageToAll("System Message: The server is shutting down after this round.");
+        }
+    }
+
+    if (!roundInProgress)
+    {
+        BroadcastMessageToAll("System Message: The server is shutting down. Thanks for playing!");
+        gameLogicDrained = true;
+    }
+}
+
+// Cross-check players, rooms and the lobby against each other. Every player is in exactly one of
+// a room or the lobby, and every room member and active peer is one of the room's players.
+// Only call it while the game logic thread isn't running, e.g. once RunServer has returned.
+// The host may be gone by then, so peers are only compared, never read.
+bool CheckGameState(string& error)
+{
+    unordered_map<ENetPeer*, PlayerId> playersByPeer;
+
+    for (PlayerId player = 0; player < players.Capacity(); player++)
+    {
+        if (players.peers[player])
+        {
+            playersByPeer[players.peers[player]] = player;
+        }
+    }
+
+    size_t playersInRooms = 0;
+
+    for (auto& entry : rooms)
+    {
+        const Room& room = entry.second;
+
+        for (ENetPeer* peer : room.members)
+        {
+            auto playerIterator = playersByPeer.find(peer);
+
+            if (playerIterator == playersByPeer.end() || players.roomIds[playerIterator->second] != room.id)
+            {
+                error = "room " + to_string(room.id) + " has a member that isn't one of its players";
+                return false;
+            }
+        }
+
+        if (room.activePeer && find(room.members.begin(), room.members.end(), room.activePeer) == room.members.end())
+        {
+            error = "room " + to_string(room.id) + "'s active peer isn't in the room";
+            return false;
+        }
+
+        playersInRooms += room.members.size();
+    }
+
+    size_t playersInLobby = 0;
+
+    for (PlayerId player = 0; player < players.Capacity(); player++)
+    {
+        if (!players.peers[player])
+        {
+            continue;
+        }
+
+        int roomId = players.roomIds[player];
+
+        if (roomId == 0 && !lobby.Contains(players.peers[player]))
+        {
+            error = string(players.GetUsername(player)) + " is in neither a room nor the lobby";
+            return false;
+        }
+
+        if (roomId != 0 && rooms.find(roomId) == rooms.end())
+        {
+            error = string(players.GetUsername(player)) + " is in room " + to_string(roomId) + ", which is gone";
+            return false;
+        }
+
+        playersInLobby += roomId == 0 ? 1 : 0;
+    }
+
+    if (playersInRooms + playersInLobby != players.Size() || lobby.Size() != playersInLobby)
+    {
+        error = to_string(players.Size()) + " players, but " + to_string(playersInRooms) + " room members and "
+            + to_string(lobby.Size()) + " in the lobby";
+        return false;
+    }
+
+    return true;
+}
+
+void ApplyGameCommand(const GameCommand& command)
+{
+    PlayerId player = players.Find(command.peer, command.connectId);
+
+    if (player != invalidPlayerId)
+    {
+        players.roundTripTimes[player] = command.roundTripTime;
+    }
+
+    switch (command.type)
+    {
+    case GCT_UserInfo:
+        HandleUserInfoCommand(command);
+        break;
+    case GCT_UserGuess:
+        HandleUserGuessCommand(command);
+        break;
+    case GCT_Subscribe:
+        HandleSubscribeCommand(command);
+        break;
+    case GCT_Disconnect:
+        HandleDisconnectCommand(command);
+        break;
+    case GCT_ReloadConfig:
+        ReloadServerConfig();
+        break;
+    default:
+        break;
+    }
+}
+
+// Game logic thread. Owns every game global; never touches the ENet host directly.
+void RunGameLogic()
+{
+    while (gameLogicRunning)
+    {
+        GameCommand command;
+        bool appliedCommand = false;
+
+        while (inboundCommands.TryPop(command))
+        {
+            ApplyGameCommand(command);
+            appliedCommand = true;
+        }
+
+        auto now = chrono::steady_clock::now();
+
+        UpdateLobby(now);
+        UpdateRoomTimers(now);
+        UpdateDrain();
+        UpdateCheckpoint(now);
+        FlushMessageBatches();
+
+        if (!appliedCommand)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
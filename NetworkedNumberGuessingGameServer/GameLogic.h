@@ -0,0 +1,169 @@
+#pragma once
+
+#include <enet/enet.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CommandQueue.h"
+#include "GamePacket.h"
+#include "GuessAnalytics.h"
+#include "Lobby.h"
+#include "MessageBatch.h"
+#include "PlayerArena.h"
+#include "RoomCheckpoint.h"
+#include "RoomTask.h"
+#include "ServerConfig.h"
+#include "TimeSync.h"
+
+using namespace std;
+
+/*
+    Game rules and state. Everything here runs on the game logic thread (RunGameLogic) except
+    GetNumberOfConnections, which reads the host's peer table and is only called from the I/O thread.
+    Kept separate from the I/O loop (ServerHost.cpp) so the benchmark can drive the same code against a mock host.
+
+    Joining players wait in the lobby until it packs them into a room. Each room runs its own
+    rounds; when a round ends with too few players left the room closes and sends them back
+    to the lobby. A player who doesn't guess within turnTimeout loses their turn.
+
+    A room's whole lifecycle is one coroutine, RunRoom: wait for players, take turns until
+    someone guesses right, cool down, repeat. Command handlers post it events and
+    UpdateRoomTimers wakes it when a wait runs out, so no room ever blocks the logic thread.
+
+    With a checkpoint file open, changed rooms are written to it every checkpointInterval.
+    Rooms restored from one wait up to resumeTimeout for their players, who rejoin by username;
+    the round carries on once whoever's turn it was is back, or the wait is over.
+
+    Broadcasts go to whoever subscribed to their SubscriptionTopic. Each room keeps a flat list
+    of subscribers per topic, rebuilt only when its players or their subscriptions change, so
+    a broadcast never walks peers that don't want it or looks players up one by one.
+
+    Player state lives in the players arena, indexed by peer. Rooms only hold their members' peers,
+    and batched messages share one text buffer per tick instead of a copy per recipient.
+*/
+
+// The subscribers of one topic. Players taking MessageBatchGamePackets come first, so messages
+// go into their batches and one shared MessageGamePacket covers the rest.
+struct TopicSubscribers
+{
+    vector<PlayerId> players;
+    size_t batchingCount = 0;
+};
+
+struct Room
+{
+    int id = 0;
+    vector<ENetPeer*> members;     // in the order they joined, which is also the turn order
+
+    int maxNumber = 100;
+    int numberToGuess = 0;
+    bool gameStarted = false;      // a round is in progress
+    ENetPeer* activePeer = nullptr;
+    chrono::steady_clock::time_point turnDeadline;
+    GuessTracker guessTracker;
+
+    // slot in the checkpoint file (-1 until first written); dirty rooms are rewritten at the next checkpoint
+    int checkpointSlot = -1;
+    bool checkpointDirty = true;
+
+    // restored from a checkpoint: players who haven't reconnected yet, and whose turn it was
+    vector<string> resumingUsernames;
+    string resumeActiveUsername;
+    chrono::steady_clock::time_point resumeDeadline;
+
+    // indexed by topic bit; rebuilt before the next broadcast once dirty
+    TopicSubscribers subscribers[subscriptionTopicCount];
+    bool subscribersDirty = true;
+
+    // RunRoom for this room; the room is erased once it returns
+    RoomTask lifecycle;
+};
+
+extern ENetHost* server;
+
+extern map<int, Room> rooms;
+extern PlayerArena players;
+extern Lobby lobby;
+extern unordered_map<string, float> winRateByUsername;
+extern unordered_map<string, int> resumingPlayers;
+extern RoomCheckpointFile roomCheckpoint;
+
+extern int requiredNumberOfPlayersToBegin;
+extern int timeToWaitForNextGame;
+extern bool analyticsEnabled;
+extern ServerConfig serverConfig;
+extern string serverConfigPath;
+
+extern RoomTimerQueue roomTimers;
+
+extern MpscRingBuffer<GameCommand, 4096> inboundCommands;
+extern SpscRingBuffer<OutboundPacket, 4096> outboundPackets;
+extern atomic<bool> gameLogicRunning;
+extern atomic<bool> drainRequested;
+extern atomic<bool> gameLogicDrained;
+extern atomic<int> drainTimeout;
+
+void WriteLocalMessage(string message);
+int GetNumberOfConnections();
+string GetUserNameFromPeer(ENetPeer* peer);
+float GetWinRate(const string& username);
+size_t GetRoomMemoryUsage(const Room& room);
+
+void QueueOutboundPacket(ENetPeer* peer, ENetPacket* packet);
+void QueueSharedPacket(const PlayerId* recipients, size_t count, ENetPacket* packet);
+const TopicSubscribers& GetRoomSubscribers(Room& room, SubscriptionTopic topic);
+const TopicSubscribers& GetServerSubscribers();
+void QueueRoomPacket(Room& room, SubscriptionTopic topic, ENetPacket* packet);
+void QueueDisconnect(ENetPeer* peer);
+void FlushMessageBatch(ENetPeer* peer);
+void FlushPlayerMessageBatch(PlayerId player);
+void FlushMessageBatches();
+ENetPacket* CreateMessagePacket(const string& message);
+void BroadcastMessage(Room& room, SubscriptionTopic topic, string message);
+void BroadcastMessageToAll(string message);
+void SendMessageToPeer(ENetPeer* peer, string message);
+void SendInputPromptToActivePeer(Room& room);
+void SendTurnToActivePeer(Room& room);
+void BroadcastGuessResult(Room& room, int guess, GuessHint hint);
+
+int GetRandomNumber(int max);
+ENetPeer* GetNextPeer(Room& room);
+void AssignNextPeer(Room& room);
+void BeginGame(Room& room);
+void EndGame(Room& room);
+bool IsCorrectGuess(Room& room, int guess);
+bool HandleGuess(Room& room, int guess);
+void RecordRoundResult(Room& room, ENetPeer* winner);
+void WriteRoundAnalytics(Room& room);
+void WriteMemoryUsage(const Room& room);
+uint32_t GetTime();
+
+Room& CreateRoom(const vector<LobbyEntry>& members);
+void CloseRoom(Room& room);
+void UpdateLobby(chrono::steady_clock::time_point now);
+void EraseRoom(int roomId);
+
+RoomTask::Awaiter WaitForRoomEvent(Room& room, chrono::steady_clock::time_point deadline, uint8_t wantedEvents);
+RoomTask RunRoom(Room& room);
+void StartRoom(Room& room);
+void PostRoomEvent(Room& room, RoomEventType type, int number = 0);
+void UpdateRoomTimers(chrono::steady_clock::time_point now);
+
+void SnapshotRoom(const Room& room, RoomSnapshot& snapshot);
+Room& RestoreRoom(const RoomSnapshot& snapshot);
+bool RestoreRooms(const string& path, string& error);
+bool OpenRoomCheckpoint(const string& path, string& error);
+void CloseRoomCheckpoint();
+void UpdateCheckpoint(chrono::steady_clock::time_point now);
+bool ResumePlayer(PlayerId player);
+void FinishResume(Room& room);
+
+void ReloadServerConfig();
+void ApplyServerConfig();
+void UpdateDrain();
+bool CheckGameState(string& error);
+void ApplyGameCommand(const GameCommand& command);
+void RunGameLogic();
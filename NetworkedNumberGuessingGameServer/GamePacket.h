@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 
 using namespace std;
 
@@ -15,9 +18,34 @@ enum PacketHeaderType
     PHT_Invalid,
     PHT_UserInfo,
     PHT_UserGuess,
-    PHT_Message
+    PHT_Message,
+    PHT_GuessResult,
+    PHT_MessageBatch,
+    PHT_Subscribe,
+    PHT_TimeSync
 };
 
+// Optional features a client supports, sent after the username in UserInfoGamePacket.
+enum UserInfoFlags : uint8_t
+{
+    UIF_MessageBatch = 1 << 0
+};
+
+// What a client hears from its room and the server, set with a SubscribeGamePacket. Everyone starts
+// subscribed to everything. Anything sent only to that client (its input prompt, the lobby's
+// welcome) always gets through.
+enum SubscriptionTopic : uint8_t
+{
+    ST_Room = 1 << 0,       // joining a room, rounds starting, the room closing
+    ST_Turns = 1 << 1,      // whose turn it is
+    ST_JoinLeave = 1 << 2,  // players leaving or coming back
+    ST_Results = 1 << 3,    // every guess and its hint, as GuessResultGamePackets and messages
+    ST_Server = 1 << 4,     // server wide notices, such as shutting down
+    ST_All = 0x1F
+};
+
+const size_t subscriptionTopicCount = 5;
+
 struct GamePacket
 {
     GamePacket() {}
@@ -32,13 +60,13 @@ struct GamePacket
     {
         // serialize type
         size_t bufferIdx = 0;
-        size_t typeSize = sizeof(&aGamePacket.type);
+        size_t typeSize = sizeof(aGamePacket.type);
         memcpy(&data[bufferIdx], &aGamePacket.type, typeSize);
 
         return typeSize;
     }
 
-    static size_t deserialize(char* data, size_t dataLength, GamePacket& aGamePacket)
+    static size_t deserialize(char* data, size_t /*dataLength*/, GamePacket& aGamePacket)
     {
         size_t buffIdx = 0;
         size_t typeSize = sizeof(type);
@@ -57,41 +85,45 @@ struct UserInfoGamePacket : GamePacket
 
     string username = "";
 
+    // UserInfoFlags. Trails the username so older servers simply ignore it.
+    uint8_t flags = 0;
+
     size_t size() const
     {
-        return GamePacket::size() + username.length() + 1;
+        return GamePacket::size() + username.length() + 1 + sizeof(flags);
     }
 
     static void serialize(const UserInfoGamePacket& aUserInfoGamePacket, char* data)
     {
-        size_t buffSize = aUserInfoGamePacket.size();
-
         size_t bufferIdx = GamePacket::serialize(aUserInfoGamePacket, data);
 
         // serialize username
         size_t usernameNameSize = aUserInfoGamePacket.username.length() + 1;
         memcpy(&data[bufferIdx], aUserInfoGamePacket.username.c_str(), usernameNameSize);
+        bufferIdx += usernameNameSize;
+
+        data[bufferIdx] = (char)aUserInfoGamePacket.flags;
     }
 
-	static void deserialize(char* data, size_t dataLength, UserInfoGamePacket& aUserInfoGamePacket)
-	{
+    // False if the packet ends before the username.
+    static bool deserialize(char* data, size_t dataLength, UserInfoGamePacket& aUserInfoGamePacket)
+    {
         size_t buffIdx = GamePacket::deserialize(data, dataLength, aUserInfoGamePacket);
 
-		std::string tmp;
-		for (size_t i = buffIdx; i < dataLength; ++i)
-		{
-			if (data[i] == '\0')
-			{
-				break;
-			}
-			else
-			{
-				tmp += data[i];
-			}
-		}
-
-		aUserInfoGamePacket.username = tmp;
-	}
+        if (dataLength <= buffIdx)
+        {
+            return false;
+        }
+
+        size_t usernameLength = strnlen(&data[buffIdx], dataLength - buffIdx);
+        aUserInfoGamePacket.username.assign(&data[buffIdx], usernameLength);
+        buffIdx += usernameLength + 1;
+
+        // older clients end at the username
+        aUserInfoGamePacket.flags = buffIdx < dataLength ? (uint8_t)data[buffIdx] : 0;
+
+        return true;
+    }
 };
 
 struct MessageGamePacket : GamePacket
@@ -110,8 +142,6 @@ struct MessageGamePacket : GamePacket
 
     static void serialize(const MessageGamePacket& aMessageGamePacket, char* data)
     {
-        size_t buffSize = aMessageGamePacket.size();
-
         size_t bufferIdx = GamePacket::serialize(aMessageGamePacket, data);
 
         // serialize message
@@ -119,28 +149,29 @@ struct MessageGamePacket : GamePacket
         memcpy(&data[bufferIdx], aMessageGamePacket.message.c_str(), messageSize);
     }
 
-    static void deserialize(char* data, size_t dataLength, MessageGamePacket& aMessageGamePacket)
+    // The message without copying it out of the packet; valid as long as data is.
+    static string_view deserializeView(const char* data, size_t dataLength)
     {
-        size_t buffIdx = GamePacket::deserialize(data, dataLength, aMessageGamePacket);
+        size_t buffIdx = GamePacket().size();
 
-        std::string tmp;
-        for (size_t i = buffIdx; i < dataLength; ++i)
+        if (dataLength <= buffIdx)
         {
-            if (data[i] == '\0')
-            {
-                break;
-            }
-            else
-            {
-                tmp += data[i];
-            }
+            return string_view();
         }
 
-        aMessageGamePacket.message = tmp;
+        return string_view(&data[buffIdx], strnlen(&data[buffIdx], dataLength - buffIdx));
+    }
+
+    static void deserialize(char* data, size_t dataLength, MessageGamePacket& aMessageGamePacket)
+    {
+        GamePacket::deserialize(data, dataLength, aMessageGamePacket);
+
+        aMessageGamePacket.message = deserializeView(data, dataLength);
     }
 };
 
 
+// A guess from a client, or from the server the prompt for one, where number is the maximum.
 struct UserGuessGamePacket : GamePacket
 {
     UserGuessGamePacket()
@@ -150,27 +181,150 @@ struct UserGuessGamePacket : GamePacket
 
     int number = 0;
 
+    // Prompts only, in microseconds on the server's clock (see TimeSync.h): when the prompt was
+    // sent and when the turn passes on. Trail the number so older clients simply ignore them.
+    int64_t serverSendTime = 0;
+    int64_t deadline = 0;
+
     size_t size() const
     {
-        return GamePacket::size() + sizeof(number);
+        return GamePacket::size() + sizeof(number) + sizeof(serverSendTime) + sizeof(deadline);
     }
 
     static void serialize(const UserGuessGamePacket& aUserGuessGamePacket, char* data)
     {
-        size_t buffSize = aUserGuessGamePacket.size();
-
         size_t bufferIdx = GamePacket::serialize(aUserGuessGamePacket, data);
 
         // serialize number
         size_t numberSize = sizeof(number);
         memcpy(&data[bufferIdx], &aUserGuessGamePacket.number, numberSize);
+        bufferIdx += numberSize;
+
+        memcpy(&data[bufferIdx], &aUserGuessGamePacket.serverSendTime, sizeof(serverSendTime));
+        bufferIdx += sizeof(serverSendTime);
+        memcpy(&data[bufferIdx], &aUserGuessGamePacket.deadline, sizeof(deadline));
     }
 
-    static void deserialize(char* data, size_t dataLength, UserGuessGamePacket& aUserGuessGamePacket)
+    // False if the packet ends before the number.
+    static bool deserialize(char* data, size_t dataLength, UserGuessGamePacket& aUserGuessGamePacket)
     {
         size_t buffIdx = GamePacket::deserialize(data, dataLength, aUserGuessGamePacket);
 
         size_t guessSize = sizeof(number);
+
+        if (dataLength < buffIdx + guessSize)
+        {
+            return false;
+        }
+
         memcpy(&aUserGuessGamePacket.number, &data[buffIdx], guessSize);
+        buffIdx += guessSize;
+
+        // older senders end at the number
+        if (dataLength < aUserGuessGamePacket.size())
+        {
+            return true;
+        }
+
+        memcpy(&aUserGuessGamePacket.serverSendTime, &data[buffIdx], sizeof(serverSendTime));
+        buffIdx += sizeof(serverSendTime);
+        memcpy(&aUserGuessGamePacket.deadline, &data[buffIdx], sizeof(deadline));
+
+        return true;
+    }
+};
+
+enum GuessHint
+{
+    GH_Correct,
+    GH_Higher,
+    GH_Lower
+};
+
+// Sent to the room after every guess: whether the number is higher or lower, and the range it must be in.
+struct GuessResultGamePacket : GamePacket
+{
+    GuessResultGamePacket()
+    {
+        type = PHT_GuessResult;
+    }
+
+    int guess = 0;
+    int hint = GH_Correct;
+    int low = 0;
+    int high = 0;
+
+    size_t size() const
+    {
+        return GamePacket::size() + sizeof(guess) + sizeof(hint) + sizeof(low) + sizeof(high);
+    }
+
+    static void serialize(const GuessResultGamePacket& aGuessResultGamePacket, char* data)
+    {
+        size_t bufferIdx = GamePacket::serialize(aGuessResultGamePacket, data);
+
+        memcpy(&data[bufferIdx], &aGuessResultGamePacket.guess, sizeof(guess));
+        bufferIdx += sizeof(guess);
+        memcpy(&data[bufferIdx], &aGuessResultGamePacket.hint, sizeof(hint));
+        bufferIdx += sizeof(hint);
+        memcpy(&data[bufferIdx], &aGuessResultGamePacket.low, sizeof(low));
+        bufferIdx += sizeof(low);
+        memcpy(&data[bufferIdx], &aGuessResultGamePacket.high, sizeof(high));
     }
-};
\ No newline at end of file
+
+    static void deserialize(char* data, size_t dataLength, GuessResultGamePacket& aGuessResultGamePacket)
+    {
+        size_t buffIdx = GamePacket::deserialize(data, dataLength, aGuessResultGamePacket);
+
+        if (dataLength < aGuessResultGamePacket.size())
+        {
+            return;
+        }
+
+        memcpy(&aGuessResultGamePacket.guess, &data[buffIdx], sizeof(guess));
+        buffIdx += sizeof(guess);
+        memcpy(&aGuessResultGamePacket.hint, &data[buffIdx], sizeof(hint));
+        buffIdx += sizeof(hint);
+        memcpy(&aGuessResultGamePacket.low, &data[buffIdx], sizeof(low));
+        buffIdx += sizeof(low);
+        memcpy(&aGuessResultGamePacket.high, &data[buffIdx], sizeof(high));
+    }
+};
+
+// Replaces the sender's subscriptions (SubscriptionTopic bits). Only applies after UserInfoGamePacket.
+struct SubscribeGamePacket : GamePacket
+{
+    SubscribeGamePacket()
+    {
+        type = PHT_Subscribe;
+    }
+
+    uint8_t topics = ST_All;
+
+    size_t size() const
+    {
+        return GamePacket::size() + sizeof(topics);
+    }
+
+    static void serialize(const SubscribeGamePacket& aSubscribeGamePacket, char* data)
+    {
+        size_t bufferIdx = GamePacket::serialize(aSubscribeGamePacket, data);
+
+        data[bufferIdx] = (char)aSubscribeGamePacket.topics;
+    }
+
+    // False if the packet ends before the topics.
+    static bool deserialize(char* data, size_t dataLength, SubscribeGamePacket& aSubscribeGamePacket)
+    {
+        size_t buffIdx = GamePacket::deserialize(data, dataLength, aSubscribeGamePacket);
+
+        if (dataLength < aSubscribeGamePacket.size())
+        {
+            return false;
+        }
+
+        aSubscribeGamePacket.topics = (uint8_t)data[buffIdx];
+
+        return true;
+    }
+};
@@ -0,0 +1,148 @@
+#include "GuessAnalytics.h"
+#include <algorithm>
+
+bool GuessedNumberSet::TestAndSet(int number)
+{
+    if (number < 1 || number > maxNumber)
+    {
+        return false;
+    }
+
+    auto position = lower_bound(numbers.begin(), numbers.end(), number);
+
+    if (position != numbers.end() && *position == number)
+    {
+        return true;
+    }
+
+    numbers.insert(position, number);
+
+    return false;
+}
+
+void GuessTracker::Reset(int newMaxNumber)
+{
+    guessed.Clear();
+    guessed.Resize(newMaxNumber);
+
+    maxNumber = newMaxNumber;
+    low = 1;
+    high = newMaxNumber;
+    duplicateGuesses = 0;
+    outOfRangeGuesses = 0;
+    history.clear();
+}
+
+GuessHint GuessTracker::RecordGuess(int guess, int numberToGuess)
+{
+    history.push_back(guess);
+
+    if (guessed.TestAndSet(guess)) duplicateGuesses++;
+    if (guess < low || guess > high) outOfRangeGuesses++;
+
+    if (guess < numberToGuess)
+    {
+        low = max(low, guess + 1);
+        return GH_Higher;
+    }
+
+    if (guess > numberToGuess)
+    {
+        high = min(high, guess - 1);
+        return GH_Lower;
+    }
+
+    low = high = guess;
+    return GH_Correct;
+}
+
+int GetOptimalGuessCount(int maxNumber)
+{
+    int guesses = 0;
+
+    for (int64_t covered = 0; covered < maxNumber; covered = covered * 2 + 1)
+    {
+        guesses++;
+    }
+
+    return guesses;
+}
+
+vector<GuessStreamScore> ScoreGuessStreams(const vector<const vector<int>*>& streams, const vector<int>& targets, int maxNumber)
+{
+    size_t roomCount = streams.size();
+    size_t longestStream = 0;
+
+    for (const vector<int>* stream : streams)
+    {
+        longestStream = max(longestStream, stream->size());
+    }
+
+    // structure of arrays, one slot per room
+    vector<int> low(roomCount, 1);
+    vector<int> high(roomCount, maxNumber);
+    vector<int> guess(roomCount, 0);
+    vector<int> active(roomCount, 0);
+    vector<int> outOfRange(roomCount, 0);
+    vector<int64_t> distance(roomCount, 0);
+
+    for (size_t step = 0; step < longestStream; step++)
+    {
+        for (size_t room = 0; room < roomCount; room++)
+        {
+            const vector<int>& stream = *streams[room];
+            active[room] = step < stream.size();
+            guess[room] = active[room] ? stream[step] : low[room];
+        }
+
+        // Branch free so it vectorizes: every room does the same work, inactive rooms are masked out.
+        for (size_t room = 0; room < roomCount; room++)
+        {
+            int g = guess[room];
+            int lo = low[room];
+            int hi = high[room];
+            int isActive = active[room];
+            int target = targets[room];
+
+            // guesses come straight from clients, so g can be anywhere in int's range
+            int midpoint = lo + (hi - lo) / 2;
+            int64_t offset = (int64_t)g - midpoint;
+            distance[room] += isActive * (offset < 0 ? -offset : offset);
+
+            int inRange = (g >= lo) & (g <= hi);
+            outOfRange[room] += isActive & (inRange ^ 1);
+
+            int numberIsHigher = isActive & (g < target);
+            int numberIsLower = isActive & (g > target);
+            low[room] = numberIsHigher ? max(lo, g + 1) : lo;
+            high[room] = numberIsLower ? min(hi, g - 1) : hi;
+        }
+    }
+
+    vector<GuessStreamScore> scores(roomCount);
+    int optimalGuesses = GetOptimalGuessCount(maxNumber);
+
+    // Duplicates need a lookup per guess, so they get their own scalar pass over one reused set.
+    GuessedNumberSet guessed;
+    guessed.Resize(maxNumber);
+
+    for (size_t room = 0; room < roomCount; room++)
+    {
+        const vector<int>& stream = *streams[room];
+        GuessStreamScore& score = scores[room];
+
+        score.guesses = (int)stream.size();
+        score.optimalGuesses = optimalGuesses;
+        score.distanceFromOptimal = distance[room];
+        score.outOfRangeGuesses = outOfRange[room];
+
+        for (int number : stream)
+        {
+            if (guessed.TestAndSet(number)) score.duplicateGuesses++;
+        }
+
+        guessed.Clear();
+    }
+
+    return scores;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "GamePacket.h"
+
+using namespace std;
+
+/*
+    Per room guess bookkeeping and batch scoring of guess streams.
+
+    A room keeps the guesses made this round, the [low, high] range the number must still be in,
+    and the set of numbers already guessed. Both grow with the guesses made, never with maxNumber,
+    so a room costs the same whether the range is a hundred numbers or a billion.
+*/
+
+// The numbers in [1, maxNumber] guessed so far, kept sorted. A round only has so many turns, so
+// a lookup is a short binary search and an insert a short move.
+class GuessedNumberSet
+{
+public:
+    void Resize(int newMaxNumber) { maxNumber = newMaxNumber; }
+
+    // Marks number as guessed and returns whether it already was.
+    bool TestAndSet(int number);
+
+    // Keeps the capacity, so the next round doesn't allocate until it outgrows this one.
+    void Clear() { numbers.clear(); }
+
+    size_t MemoryUsage() const { return numbers.capacity() * sizeof(int); }
+
+private:
+    vector<int> numbers;
+    int maxNumber = 0;
+};
+
+struct GuessTracker
+{
+    int maxNumber = 0;
+    int low = 1;
+    int high = 0;
+    int duplicateGuesses = 0;
+    int outOfRangeGuesses = 0;
+    vector<int> history;
+    GuessedNumberSet guessed;
+
+    void Reset(int newMaxNumber);
+
+    // Records a guess against the number to guess and narrows [low, high]. Counts it in duplicateGuesses
+    // if it was guessed before and in outOfRangeGuesses if it was outside [low, high] at the time.
+    GuessHint RecordGuess(int guess, int numberToGuess);
+};
+
+// How one room's guesses compare to a binary search over the same range.
+struct GuessStreamScore
+{
+    int guesses = 0;
+    int optimalGuesses = 0;         // worst case for a binary search over [1, maxNumber]
+    int64_t distanceFromOptimal = 0; // sum of |guess - midpoint of the feasible range|
+    int duplicateGuesses = 0;
+    int outOfRangeGuesses = 0;
+};
+
+// Number of guesses a binary search needs in the worst case over [1, maxNumber].
+int GetOptimalGuessCount(int maxNumber);
+
+/*
+    Score many rooms at once. streams[i] is room i's guesses in order and targets[i] its number.
+    Rooms are processed in lockstep, one guess per room per pass, over structure-of-arrays state
+    so the range narrowing compiles to vector min/max/select instructions.
+*/
+vector<GuessStreamScore> ScoreGuessStreams(const vector<const vector<int>*>& streams, const vector<int>& targets, int maxNumber);
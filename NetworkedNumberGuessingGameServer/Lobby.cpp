@@ -0,0 +1,212 @@
+#include "Lobby.h"
+#include <algorithm>
+#include <limits>
+
+int64_t Lobby::GetMatchRating(uint32_t roundTripTime, float winRate)
+{
+    int64_t bucket = min<int64_t>(roundTripTime / roundTripTimeBucket, maxRoundTripTimeBucket);
+    int64_t winRatePermille = (int64_t)(min(max(winRate, 0.0f), 1.0f) * 1000.0f);
+
+    // a whole bucket is worth more than any win rate difference
+    return bucket * 1001 + winRatePermille;
+}
+
+bool Lobby::Enqueue(const LobbyEntry& entry)
+{
+    if (byPeer.count(entry.peer))
+    {
+        return false;
+    }
+
+    RatingKey key = { GetMatchRating(entry.roundTripTime, entry.winRate), nextSequence++ };
+
+    auto position = byRating.emplace(key, QueuedPlayer{ entry }).first;
+    byAge.emplace(key.sequence, key);
+    byPeer.emplace(entry.peer, key);
+    byEnqueueTime.emplace(entry.enqueueTime, key.sequence);
+
+    MarkNeighboursUnchecked(position);
+
+    return true;
+}
+
+bool Lobby::Remove(ENetPeer* peer)
+{
+    auto iterator = byPeer.find(peer);
+
+    if (iterator == byPeer.end())
+    {
+        return false;
+    }
+
+    Erase(byRating.find(iterator->second));
+
+    return true;
+}
+
+bool Lobby::TryFormRoom(chrono::steady_clock::time_point now, size_t targetSize, size_t minimumSize,
+    chrono::milliseconds timeout, vector<LobbyEntry>& members)
+{
+    if (byRating.size() < minimumSize)
+    {
+        return false;
+    }
+
+    // a player who couldn't start a room with one size or spread might with another
+    if (targetSize != checkedTargetSize || matchSpread != checkedMatchSpread)
+    {
+        for (auto iterator = byRating.begin(); iterator != byRating.end(); ++iterator)
+        {
+            MarkUnchecked(iterator);
+        }
+
+        checkedTargetSize = targetSize;
+        checkedMatchSpread = matchSpread;
+    }
+
+    vector<map<RatingKey, QueuedPlayer>::iterator> picked;
+
+    // whoever has waited longest is the first to time out, and then takes whoever is closest
+    auto oldest = byEnqueueTime.begin();
+
+    if (oldest != byEnqueueTime.end() && now - oldest->first >= timeout)
+    {
+        PickMembers(byRating.find(byAge[oldest->second]), now, targetSize, minimumSize, timeout, picked);
+    }
+
+    // longest waiting first, but a player nobody is close to yet doesn't hold up everyone behind them
+    while (picked.empty() && !unchecked.empty())
+    {
+        auto anchor = byRating.find(byAge[*unchecked.begin()]);
+        anchor->second.unchecked = false;
+        unchecked.erase(unchecked.begin());
+
+        PickMembers(anchor, now, targetSize, minimumSize, timeout, picked);
+    }
+
+    if (picked.empty())
+    {
+        return false;
+    }
+
+    members.clear();
+
+    for (auto& iterator : picked)
+    {
+        members.push_back(iterator->second.entry);
+        Erase(iterator);
+    }
+
+    return true;
+}
+
+bool Lobby::PickMembers(map<RatingKey, QueuedPlayer>::iterator anchor, chrono::steady_clock::time_point now,
+    size_t targetSize, size_t minimumSize, chrono::milliseconds timeout, vector<map<RatingKey, QueuedPlayer>::iterator>& picked)
+{
+    bool timedOut = now - anchor->second.entry.enqueueTime >= timeout;
+    int64_t spread = timedOut ? numeric_limits<int64_t>::max() : matchSpread;
+    int64_t anchorRating = anchor->first.rating;
+
+    // walk outwards from the anchor, always taking whichever side is closer in rating
+    picked.assign(1, anchor);
+    auto below = anchor;
+    auto above = next(anchor);
+
+    while (picked.size() < targetSize)
+    {
+        bool hasBelow = below != byRating.begin();
+        bool hasAbove = above != byRating.end();
+
+        if (!hasBelow && !hasAbove)
+        {
+            break;
+        }
+
+        int64_t belowDistance = hasBelow ? anchorRating - prev(below)->first.rating : numeric_limits<int64_t>::max();
+        int64_t aboveDistance = hasAbove ? above->first.rating - anchorRating : numeric_limits<int64_t>::max();
+
+        if (min(belowDistance, aboveDistance) > spread)
+        {
+            break;
+        }
+
+        if (hasBelow && belowDistance <= aboveDistance)
+        {
+            --below;
+            picked.push_back(below);
+        }
+        else
+        {
+            picked.push_back(above);
+            ++above;
+        }
+    }
+
+    bool full = picked.size() >= targetSize;
+
+    if (!full && !(timedOut && picked.size() >= minimumSize))
+    {
+        picked.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void Lobby::MarkUnchecked(map<RatingKey, QueuedPlayer>::iterator position)
+{
+    if (!position->second.unchecked)
+    {
+        position->second.unchecked = true;
+        unchecked.insert(position->first.sequence);
+    }
+}
+
+void Lobby::MarkNeighboursUnchecked(map<RatingKey, QueuedPlayer>::iterator position)
+{
+    MarkUnchecked(position);
+
+    // Anyone with checkedTargetSize players between them and position already had a full room
+    // within their spread before position joined, so they're still unchecked from then.
+    int64_t rating = position->first.rating;
+    auto below = position;
+    auto above = next(position);
+
+    for (size_t i = 0; i < checkedTargetSize && below != byRating.begin(); i++)
+    {
+        --below;
+
+        if (rating - below->first.rating > matchSpread)
+        {
+            break;
+        }
+
+        MarkUnchecked(below);
+    }
+
+    for (size_t i = 0; i < checkedTargetSize && above != byRating.end(); i++, ++above)
+    {
+        if (above->first.rating - rating > matchSpread)
+        {
+            break;
+        }
+
+        MarkUnchecked(above);
+    }
+}
+
+void Lobby::Erase(map<RatingKey, QueuedPlayer>::iterator position)
+{
+    uint64_t sequence = position->first.sequence;
+
+    byAge.erase(sequence);
+    byPeer.erase(position->second.entry.peer);
+    byEnqueueTime.erase({ position->second.entry.enqueueTime, sequence });
+
+    if (position->second.unchecked)
+    {
+        unchecked.erase(sequence);
+    }
+
+    byRating.erase(position);
+}
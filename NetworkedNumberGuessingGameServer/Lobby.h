@@ -0,0 +1,104 @@
+#pragma once
+
+#include <enet/enet.h>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+    Players who have joined but aren't in a room yet.
+
+    Players are ordered by a match rating built from their round trip time (coarse buckets, so
+    latency dominates) and their recent win rate, and separately by how long they've waited.
+    Forming a room starts at the player who has waited longest and takes their nearest neighbours
+    by rating. If that player can't make a room yet, the next longest waiting player is tried, and
+    so on, so one player with no one near them doesn't hold up everyone queued behind them.
+
+    Only players who might be able to start a room are tried: a player who couldn't start one isn't
+    tried again until someone joins close to their rating. Queueing is O(room size * log n), a tick
+    where no room forms is O(log n), and each player tried costs O(room size).
+
+    Fill or timeout: a room forms as soon as targetSize players fit within matchSpread of the
+    player it starts at. Once that player has waited timeout, the spread is ignored and a room
+    forms with whoever is closest, as long as there are at least minimumSize of them.
+*/
+
+struct LobbyEntry
+{
+    ENetPeer* peer = nullptr;
+    uint32_t roundTripTime = 0;
+    float winRate = 0.5f;
+    chrono::steady_clock::time_point enqueueTime;
+};
+
+class Lobby
+{
+public:
+    // round trip times within the same bucket are treated as equal
+    static const int roundTripTimeBucket = 50;
+    static const int maxRoundTripTimeBucket = 20;
+
+    // widest rating difference a room may span before the longest waiting player times out
+    int matchSpread = 250;
+
+    static int64_t GetMatchRating(uint32_t roundTripTime, float winRate);
+
+    // Returns false if the peer is already queued.
+    bool Enqueue(const LobbyEntry& entry);
+
+    // Returns false if the peer wasn't queued.
+    bool Remove(ENetPeer* peer);
+
+    bool Contains(ENetPeer* peer) const { return byPeer.count(peer) != 0; }
+    size_t Size() const { return byRating.size(); }
+
+    // Takes the players for one room out of the queue. Returns false if no room is ready yet.
+    bool TryFormRoom(chrono::steady_clock::time_point now, size_t targetSize, size_t minimumSize,
+        chrono::milliseconds timeout, vector<LobbyEntry>& members);
+
+private:
+    struct RatingKey
+    {
+        int64_t rating;
+        uint64_t sequence;
+
+        bool operator<(const RatingKey& other) const
+        {
+            return rating != other.rating ? rating < other.rating : sequence < other.sequence;
+        }
+    };
+
+    struct QueuedPlayer
+    {
+        LobbyEntry entry;
+        bool unchecked = false;     // in unchecked, so marking them again costs nothing
+    };
+
+    // Picks anchor and its nearest neighbours for a room, or returns false and leaves picked empty.
+    bool PickMembers(map<RatingKey, QueuedPlayer>::iterator anchor, chrono::steady_clock::time_point now, size_t targetSize,
+        size_t minimumSize, chrono::milliseconds timeout, vector<map<RatingKey, QueuedPlayer>::iterator>& picked);
+
+    void MarkUnchecked(map<RatingKey, QueuedPlayer>::iterator position);
+
+    // Marks the players whose rooms a newcomer at position could complete as worth trying again.
+    void MarkNeighboursUnchecked(map<RatingKey, QueuedPlayer>::iterator position);
+
+    void Erase(map<RatingKey, QueuedPlayer>::iterator position);
+
+    map<RatingKey, QueuedPlayer> byRating;
+    map<uint64_t, RatingKey> byAge;     // keyed by sequence, so the first entry waited longest
+    unordered_map<ENetPeer*, RatingKey> byPeer;
+    set<pair<chrono::steady_clock::time_point, uint64_t>> byEnqueueTime;    // the first entry times out first
+    set<uint64_t> unchecked;            // sequences of players who might be able to start a room
+    uint64_t nextSequence = 0;
+
+    // the room size and spread unchecked is relative to; changing either means trying everyone again
+    size_t checkedTargetSize = 0;
+    int checkedMatchSpread = -1;
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "GamePacket.h"
+#include "StringArena.h"
+
+using namespace std;
+
+/*
+    Several chat/system messages packed into one packet, compressed against two dictionaries.
+    Only sent to clients that set UIF_MessageBatch in their UserInfoGamePacket; everyone else
+    still gets one MessageGamePacket per message.
+
+    Packet:  type | uint8 message count | (uint16 encoded length | encoded message) * count
+
+    An encoded message is plain text where these bytes start a token:
+        MT_Static    index          a phrase from staticMessagePhrases
+        MT_Reference index          a word from this connection's dictionary
+        MT_Define    length bytes   a literal word, also stored in the next connection dictionary slot
+        MT_Escape    byte           a literal control byte
+
+    The connection dictionary is rebuilt identically on both ends from the MT_Define tokens, so
+    batches must be decoded in the order they were encoded (they all go reliable on channel 0).
+    Words are what usernames end up as, so after a player's first mention it costs two bytes.
+    The encoder only defines words that fit a StringArena slot; longer ones go as plain text.
+
+    staticMessagePhrases is part of the protocol: only ever append to it.
+*/
+
+enum MessageToken : uint8_t
+{
+    MT_Static = 1,
+    MT_Reference,
+    MT_Define,
+    MT_Escape
+};
+
+const char* const staticMessagePhrases[] =
+{
+    "System Message: ",
+    "It is now ",
+    "'s turn.",
+    " has left the game.",
+    "Starting new game. (",
+    " players)\nMinimum guess: 1, Maximum: ",
+    "Correct number guessed (",
+    "Incorrect number guessed (",
+    ") by ",
+    ". They are the winner!",
+    "Joined room ",
+    " with ",
+    "Welcome ",
+    ". Finding you a room... (",
+    " waiting)",
+    "Not enough players left in this room, returning to the lobby.",
+    "The server is shutting down",
+    " after this round.",
+    ". Thanks for playing!",
+    ". Please try again later.",
+    " is back in room ",
+    " ran out of time."
+};
+
+const size_t staticMessagePhraseCount = sizeof(staticMessagePhrases) / sizeof(staticMessagePhrases[0]);
+
+const size_t connectionDictionarySize = 32;
+const size_t minimumDictionaryWordLength = 4;
+
+// Keep a batch to roughly one datagram.
+const size_t maxMessageBatchSize = 1200;
+const size_t maxMessagesPerBatch = 255;
+
+// Encoding at most doubles a message (every byte escaped) and the result has to fit a uint16 length.
+const size_t maxBatchedMessageLength = UINT16_MAX / 2;
+
+inline bool IsDictionaryWordCharacter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-'
+        || (unsigned char)c >= 0x80;
+}
+
+// Server side, one per connection. The dictionary holds ids of words interned in a StringArena
+// shared by every connection, so it's a fixed 132 bytes however long the words are.
+struct MessageEncoder
+{
+    StringId entries[connectionDictionarySize];
+    uint8_t entryCount = 0;
+    uint8_t nextSlot = 0;
+
+    // Appends the encoded form of text to out.
+    void Encode(string_view text, string& out, StringArena& words)
+    {
+        size_t i = 0;
+
+        while (i < text.size())
+        {
+            // longest static phrase starting here
+            size_t bestLength = 0;
+            size_t bestIndex = 0;
+
+            for (size_t phrase = 0; phrase < staticMessagePhraseCount; phrase++)
+            {
+                if (staticMessagePhrases[phrase][0] != text[i]) continue;
+
+                size_t length = strlen(staticMessagePhrases[phrase]);
+
+                if (length > bestLength && text.compare(i, length, staticMessagePhrases[phrase]) == 0)
+                {
+                    bestLength = length;
+                    bestIndex = phrase;
+                }
+            }
+
+            if (bestLength > 0)
+            {
+                out += (char)MT_Static;
+                out += (char)bestIndex;
+                i += bestLength;
+                continue;
+            }
+
+            bool wordStart = i == 0 || !IsDictionaryWordCharacter(text[i - 1]);
+            size_t wordEnd = i;
+
+            while (wordStart && wordEnd < text.size() && IsDictionaryWordCharacter(text[wordEnd]))
+            {
+                wordEnd++;
+            }
+
+            size_t wordLength = wordEnd - i;
+
+            if (wordLength >= minimumDictionaryWordLength && wordLength <= maxInternedStringLength)
+            {
+                string_view word = text.substr(i, wordLength);
+                StringId id = words.Find(word);
+                size_t entry = 0;
+
+                while (entry < entryCount && (id == invalidStringId || entries[entry] != id))
+                {
+                    entry++;
+                }
+
+                if (entry < entryCount)
+                {
+                    out += (char)MT_Reference;
+                    out += (char)entry;
+                }
+                else
+                {
+                    // the same slot the decoder fills next
+                    if (entryCount < connectionDictionarySize) entryCount++;
+                    else words.Release(entries[nextSlot]);
+
+                    entries[nextSlot] = words.Intern(word);
+                    nextSlot = (nextSlot + 1) % connectionDictionarySize;
+
+                    out += (char)MT_Define;
+                    out += (char)wordLength;
+                    out.append(word);
+                }
+
+                i = wordEnd;
+                continue;
+            }
+
+            char c = text[i++];
+
+            if ((unsigned char)c < 0x20 && c != '\n')
+            {
+                out += (char)MT_Escape;
+            }
+
+            out += c;
+        }
+    }
+
+    // Gives the dictionary's words back, for when the connection is gone.
+    void Reset(StringArena& words)
+    {
+        for (size_t entry = 0; entry < entryCount; entry++)
+        {
+            words.Release(entries[entry]);
+        }
+
+        entryCount = 0;
+        nextSlot = 0;
+    }
+};
+
+// Client side, one per connection.
+struct MessageDecoder
+{
+    vector<string> entries;
+    size_t nextSlot = 0;
+
+    // Appends the decoded text to out. Returns false on a malformed message.
+    bool Decode(const char* data, size_t dataLength, string& out)
+    {
+        size_t i = 0;
+
+        while (i < dataLength)
+        {
+            unsigned char byte = (unsigned char)data[i++];
+
+            if (byte == '\n' || byte >= 0x20)
+            {
+                out += (char)byte;
+                continue;
+            }
+
+            if (i >= dataLength)
+            {
+                return false;
+            }
+
+            size_t operand = (unsigned char)data[i++];
+
+            switch (byte)
+            {
+            case MT_Static:
+                if (operand >= staticMessagePhraseCount) return false;
+                out += staticMessagePhrases[operand];
+                break;
+            case MT_Reference:
+                if (operand >= entries.size()) return false;
+                out += entries[operand];
+                break;
+            case MT_Define:
+                if (operand > dataLength - i) return false;
+                if (entries.size() < connectionDictionarySize) entries.emplace_back();
+                entries[nextSlot].assign(&data[i], operand);
+                nextSlot = (nextSlot + 1) % connectionDictionarySize;
+                out.append(&data[i], operand);
+                i += operand;
+                break;
+            case MT_Escape:
+                out += (char)operand;
+                break;
+            default:
+                return false;
+            }
+        }
+
+        return true;
+    }
+};
+
+struct MessageBatchGamePacket : GamePacket
+{
+    MessageBatchGamePacket()
+    {
+        type = PHT_MessageBatch;
+    }
+
+    // Start an empty batch in data.
+    static void begin(string& data)
+    {
+        MessageBatchGamePacket messageBatchGP;
+
+        data.resize(messageBatchGP.size() + 1);
+        GamePacket::serialize(messageBatchGP, &data[0]);
+        data.back() = 0;
+    }
+
+    static size_t count(const string& data)
+    {
+        return (unsigned char)data[GamePacket().size()];
+    }
+
+    // Encode one message onto the end of the batch. encoded is scratch space. Returns false, leaving the
+    // batch and the encoder's dictionary as they were, for a message over maxBatchedMessageLength.
+    static bool append(string& data, string_view message, MessageEncoder& encoder, StringArena& words, string& encoded)
+    {
+        if (message.size() > maxBatchedMessageLength)
+        {
+            return false;
+        }
+
+        encoded.clear();
+        encoder.Encode(message, encoded, words);
+
+        uint16_t length = (uint16_t)encoded.size();
+
+        data.append((const char*)&length, sizeof(length));
+        data.append(encoded);
+        data[GamePacket().size()]++;
+
+        return true;
+    }
+
+    // Decode every message in the batch. The views point into text and stay valid until it changes.
+    static bool deserialize(const char* data, size_t dataLength, MessageDecoder& decoder, string& text, vector<string_view>& messages)
+    {
+        GamePacket gamePacket;
+        size_t buffIdx = gamePacket.size();
+
+        text.clear();
+        messages.clear();
+
+        if (dataLength <= buffIdx)
+        {
+            return false;
+        }
+
+        size_t messageCount = (unsigned char)data[buffIdx++];
+        size_t ends[maxMessagesPerBatch];
+
+        for (size_t message = 0; message < messageCount; message++)
+        {
+            uint16_t length = 0;
+
+            if (dataLength - buffIdx < sizeof(length))
+            {
+                return false;
+            }
+
+            memcpy(&length, &data[buffIdx], sizeof(length));
+            buffIdx += sizeof(length);
+
+            if (dataLength - buffIdx < length || !decoder.Decode(&data[buffIdx], length, text))
+            {
+                return false;
+            }
+
+            buffIdx += length;
+            ends[message] = text.size();
+        }
+
+        // only now that text has stopped growing
+        size_t start = 0;
+
+        for (size_t message = 0; message < messageCount; message++)
+        {
+            messages.push_back(string_view(text).substr(start, ends[message] - start));
+            start = ends[message];
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,106 @@
+#include "PlayerArena.h"
+#include "CommandQueue.h"
+#include "GamePacket.h"
+
+PlayerId PlayerArena::Find(const ENetPeer* peer) const
+{
+    if (!peer || peer->incomingPeerID >= peers.size() || peers[peer->incomingPeerID] != peer)
+    {
+        return invalidPlayerId;
+    }
+
+    return peer->incomingPeerID;
+}
+
+PlayerId PlayerArena::Find(const ENetPeer* peer, uint32_t connectId) const
+{
+    PlayerId player = Find(peer);
+
+    if (player == invalidPlayerId || connectIds[player] != connectId)
+    {
+        return invalidPlayerId;
+    }
+
+    return player;
+}
+
+PlayerId PlayerArena::Add(ENetPeer* peer, uint32_t connectId, string_view username)
+{
+    if (Find(peer) != invalidPlayerId)
+    {
+        return invalidPlayerId;
+    }
+
+    PlayerId player = peer->incomingPeerID;
+
+    if (player >= peers.size())
+    {
+        Grow(player + 1);
+    }
+
+    peers[player] = peer;
+    connectIds[player] = connectId;
+    usernames[player] = strings.Intern(username.substr(0, maxUsernameLength));
+    roundTripTimes[player] = 0;
+    roomIds[player] = 0;
+    flags[player] = 0;
+    subscriptionTopics[player] = ST_All;
+    firstPendingMessages[player] = noPendingMessage;
+    lastPendingMessages[player] = noPendingMessage;
+    messageEncoders[player] = MessageEncoder();
+
+    playerCount++;
+
+    return player;
+}
+
+void PlayerArena::Remove(PlayerId player)
+{
+    if (player >= peers.size() || !peers[player])
+    {
+        return;
+    }
+
+    strings.Release(usernames[player]);
+    messageEncoders[player].Reset(strings);
+
+    peers[player] = nullptr;
+    usernames[player] = invalidStringId;
+    firstPendingMessages[player] = noPendingMessage;
+    lastPendingMessages[player] = noPendingMessage;
+
+    playerCount--;
+}
+
+void PlayerArena::Clear()
+{
+    for (PlayerId player = 0; player < peers.size(); player++)
+    {
+        Remove(player);
+    }
+}
+
+// Grow by doubling so a host's peers fill it in O(log n) steps.
+void PlayerArena::Grow(size_t capacity)
+{
+    capacity = max(capacity, peers.size() * 2);
+
+    peers.resize(capacity, nullptr);
+    connectIds.resize(capacity, 0);
+    usernames.resize(capacity, invalidStringId);
+    roundTripTimes.resize(capacity, 0);
+    roomIds.resize(capacity, 0);
+    flags.resize(capacity, 0);
+    subscriptionTopics.resize(capacity, 0);
+    firstPendingMessages.resize(capacity, noPendingMessage);
+    lastPendingMessages.resize(capacity, noPendingMessage);
+    messageEncoders.resize(capacity);
+}
+
+size_t PlayerArena::MemoryUsage() const
+{
+    size_t columnSize = sizeof(ENetPeer*) + sizeof(uint32_t) + sizeof(StringId) + sizeof(uint32_t) + sizeof(int32_t)
+        + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(MessageEncoder);
+
+    return peers.capacity() * columnSize + strings.MemoryUsage();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <enet/enet.h>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "MessageBatch.h"
+#include "StringArena.h"
+
+using namespace std;
+
+/*
+    Per-player state as flat columns indexed by the peer's incomingPeerID, so finding a player is
+    an array index and walking a room reads a few dense arrays instead of a heap node per player.
+
+    ENet hands a peer slot to the next connection once the last one is gone, so each slot also
+    records the connectID it was added with, and lookups made on behalf of a connection check it.
+
+    Usernames (capped at maxUsernameLength) and message dictionary words are interned in strings.
+*/
+
+typedef uint32_t PlayerId;
+
+const PlayerId invalidPlayerId = UINT32_MAX;
+
+// no batched messages waiting, see GameLogic.cpp
+const uint32_t noPendingMessage = UINT32_MAX;
+
+enum PlayerFlags : uint8_t
+{
+    PF_MessageBatching = 1 << 0     // takes MessageBatchGamePackets
+};
+
+struct PlayerArena
+{
+    // One entry per peer slot. peers is null where there's no player.
+    vector<ENetPeer*> peers;
+    vector<uint32_t> connectIds;
+    vector<StringId> usernames;
+    vector<uint32_t> roundTripTimes;
+    vector<int32_t> roomIds;                // 0 while in the lobby
+    vector<uint8_t> flags;                  // PlayerFlags
+    vector<uint8_t> subscriptionTopics;     // SubscriptionTopic bits
+
+    // batched messages waiting for the end of the tick, a chain through GameLogic's pendingMessages
+    vector<uint32_t> firstPendingMessages;
+    vector<uint32_t> lastPendingMessages;
+
+    // only used for players with PF_MessageBatching
+    vector<MessageEncoder> messageEncoders;
+
+    StringArena strings;
+
+    // Returns invalidPlayerId if the peer has no player.
+    PlayerId Find(const ENetPeer* peer) const;
+
+    // Also invalidPlayerId if the player belongs to an earlier connection on the same peer slot.
+    PlayerId Find(const ENetPeer* peer, uint32_t connectId) const;
+
+    // Returns invalidPlayerId if the peer already has a player.
+    PlayerId Add(ENetPeer* peer, uint32_t connectId, string_view username);
+    void Remove(PlayerId player);
+    void Clear();
+
+    string_view GetUsername(PlayerId player) const { return strings.Get(usernames[player]); }
+    size_t Size() const { return playerCount; }
+
+    // Slots to check when walking every player.
+    size_t Capacity() const { return peers.size(); }
+
+    // The columns and the string arena, in bytes.
+    size_t MemoryUsage() const;
+
+private:
+    void Grow(size_t capacity);
+
+    size_t playerCount = 0;
+};
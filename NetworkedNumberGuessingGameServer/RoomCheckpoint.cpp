@@ -0,0 +1,400 @@
+#include "RoomCheckpoint.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t checkpointFileMagic = 0x43474E4E;   // "NNGC"
+const uint32_t checkpointFileVersion = 1;
+const size_t initialSlotCount = 64;
+
+uint32_t GetRoomSnapshotChecksum(const RoomSnapshot& snapshot)
+{
+    // FNV-1a
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&snapshot.sequence);
+    size_t length = sizeof(RoomSnapshot) - offsetof(RoomSnapshot, sequence);
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+bool RoomCheckpointFile::Open(const string& filePath, bool create, string& error)
+{
+    Close();
+    path = filePath;
+
+    size_t existingSize = 0;
+
+    if (!OpenFile(create, existingSize))
+    {
+        error = "could not open " + path;
+        return false;
+    }
+
+    if (existingSize == 0 && create)
+    {
+        if (!Map(initialSlotCount, error))
+        {
+            Close();
+            return false;
+        }
+
+        FileHeader* header = reinterpret_cast<FileHeader*>(mapping);
+        header->magic = checkpointFileMagic;
+        header->version = checkpointFileVersion;
+        header->slotCount = slotCount;
+    }
+    else
+    {
+        if (existingSize < sizeof(FileHeader) || !Map((existingSize - sizeof(FileHeader)) / sizeof(Slot), error))
+        {
+            error = path + " is not a room checkpoint file";
+            Close();
+            return false;
+        }
+
+        FileHeader* header = reinterpret_cast<FileHeader*>(mapping);
+
+        if (header->magic != checkpointFileMagic || header->version != checkpointFileVersion || header->slotCount > slotCount)
+        {
+            error = path + " is not a room checkpoint file";
+            Close();
+            return false;
+        }
+
+        // a crash while growing can leave the file longer than the header says
+        slotCount = (size_t)header->slotCount;
+    }
+
+    // slots without an intact copy are free, lowest first
+    for (int slot = (int)slotCount - 1; slot >= 0; slot--)
+    {
+        if (!GetNewestCopy(slot))
+        {
+            freeSlots.push_back(slot);
+        }
+    }
+
+    return true;
+}
+
+#ifdef _WIN32
+
+bool RoomCheckpointFile::OpenFile(bool create, size_t& existingSize)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    existingSize = (size_t)fileSize.QuadPart;
+
+    return true;
+}
+
+bool RoomCheckpointFile::Map(size_t newSlotCount, string& error)
+{
+    Unmap();
+
+    size_t size = sizeof(FileHeader) + newSlotCount * sizeof(Slot);
+
+    // creating the mapping grows the file to size if it's smaller
+    HANDLE mappingObject = CreateFileMappingA((HANDLE)fileHandle, NULL, PAGE_READWRITE,
+        (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+
+    if (!mappingObject)
+    {
+        error = "could not map " + path;
+        return false;
+    }
+
+    void* view = MapViewOfFile(mappingObject, FILE_MAP_ALL_ACCESS, 0, 0, size);
+
+    if (!view)
+    {
+        CloseHandle(mappingObject);
+        error = "could not map " + path;
+        return false;
+    }
+
+    mappingHandle = mappingObject;
+    mapping = (char*)view;
+    mappingSize = size;
+    slotCount = newSlotCount;
+
+    return true;
+}
+
+void RoomCheckpointFile::Unmap()
+{
+    if (mapping)
+    {
+        FlushViewOfFile(mapping, 0);
+        UnmapViewOfFile(mapping);
+        CloseHandle((HANDLE)mappingHandle);
+    }
+
+    mapping = nullptr;
+    mappingHandle = nullptr;
+    mappingSize = 0;
+}
+
+void RoomCheckpointFile::Close()
+{
+    Unmap();
+
+    if (fileHandle)
+    {
+        CloseHandle((HANDLE)fileHandle);
+    }
+
+    fileHandle = nullptr;
+    slotCount = 0;
+    freeSlots.clear();
+}
+
+void FlushMappedRange(void* address, size_t length)
+{
+    FlushViewOfFile(address, length);
+}
+
+#else
+
+bool RoomCheckpointFile::OpenFile(bool create, size_t& existingSize)
+{
+    fileDescriptor = open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+
+    if (fileDescriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStatus;
+    fstat(fileDescriptor, &fileStatus);
+    existingSize = (size_t)fileStatus.st_size;
+
+    return true;
+}
+
+bool RoomCheckpointFile::Map(size_t newSlotCount, string& error)
+{
+    Unmap();
+
+    size_t size = sizeof(FileHeader) + newSlotCount * sizeof(Slot);
+    struct stat fileStatus;
+
+    if (fstat(fileDescriptor, &fileStatus) != 0 || ((size_t)fileStatus.st_size < size && ftruncate(fileDescriptor, (off_t)size) != 0))
+    {
+        error = "could not grow " + path;
+        return false;
+    }
+
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+
+    if (view == MAP_FAILED)
+    {
+        error = "could not map " + path;
+        return false;
+    }
+
+    mapping = (char*)view;
+    mappingSize = size;
+    slotCount = newSlotCount;
+
+    return true;
+}
+
+void RoomCheckpointFile::Unmap()
+{
+    if (mapping)
+    {
+        msync(mapping, mappingSize, MS_ASYNC);
+        munmap(mapping, mappingSize);
+    }
+
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+void RoomCheckpointFile::Close()
+{
+    Unmap();
+
+    if (fileDescriptor >= 0)
+    {
+        close(fileDescriptor);
+    }
+
+    fileDescriptor = -1;
+    slotCount = 0;
+    freeSlots.clear();
+}
+
+// Ask the OS to start writing the range back; the process can die any time after the memcpy anyway.
+void FlushMappedRange(void* address, size_t length)
+{
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)address & ~(pageSize - 1);
+
+    msync((void*)start, (uintptr_t)address + length - start, MS_ASYNC);
+}
+
+#endif
+
+void RoomCheckpointFile::Reset()
+{
+    freeSlots.clear();
+
+    for (int slot = (int)slotCount - 1; slot >= 0; slot--)
+    {
+        GetSlot(slot)->copies[0].magic = 0;
+        GetSlot(slot)->copies[1].magic = 0;
+        freeSlots.push_back(slot);
+    }
+}
+
+int RoomCheckpointFile::AllocateSlot()
+{
+    if (!mapping)
+    {
+        return -1;
+    }
+
+    if (freeSlots.empty())
+    {
+        size_t oldSlotCount = slotCount;
+        string error;
+
+        // a header can say zero slots, and doubling that would never make room
+        if (!Map(max(slotCount * 2, initialSlotCount), error))
+        {
+            // put the old mapping back so existing slots keep working
+            Map(oldSlotCount, error);
+            return -1;
+        }
+
+        reinterpret_cast<FileHeader*>(mapping)->slotCount = slotCount;
+
+        for (int slot = (int)slotCount - 1; slot >= (int)oldSlotCount; slot--)
+        {
+            freeSlots.push_back(slot);
+        }
+    }
+
+    if (freeSlots.empty())
+    {
+        return -1;
+    }
+
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    return slot;
+}
+
+void RoomCheckpointFile::FreeSlot(int slot)
+{
+    if (!mapping || slot < 0 || (size_t)slot >= slotCount)
+    {
+        return;
+    }
+
+    Slot* freedSlot = GetSlot(slot);
+    freedSlot->copies[0].magic = 0;
+    freedSlot->copies[1].magic = 0;
+
+    freeSlots.push_back(slot);
+}
+
+void RoomCheckpointFile::WriteSlot(int slot, const RoomSnapshot& snapshot)
+{
+    if (!mapping || slot < 0 || (size_t)slot >= slotCount)
+    {
+        return;
+    }
+
+    Slot* targetSlot = GetSlot(slot);
+    uint64_t newestSequence = 0;
+
+    // only this process writes the slot, so there's no need to verify its own copies here
+    for (const RoomSnapshot& existing : targetSlot->copies)
+    {
+        if (existing.magic == roomSnapshotMagic) newestSequence = max(newestSequence, existing.sequence);
+    }
+
+    RoomSnapshot copy = snapshot;
+    copy.magic = roomSnapshotMagic;
+    copy.sequence = newestSequence + 1;
+    copy.checksum = GetRoomSnapshotChecksum(copy);
+
+    // never overwrite the newest intact copy
+    RoomSnapshot* target = &targetSlot->copies[copy.sequence & 1];
+    memcpy((void*)target, &copy, sizeof(copy));
+}
+
+void RoomCheckpointFile::Flush()
+{
+    if (mapping)
+    {
+        FlushMappedRange(mapping, mappingSize);
+    }
+}
+
+vector<RoomSnapshot> RoomCheckpointFile::ReadSnapshots() const
+{
+    vector<RoomSnapshot> snapshots;
+
+    for (size_t slot = 0; slot < slotCount; slot++)
+    {
+        const RoomSnapshot* newest = GetNewestCopy((int)slot);
+
+        if (newest)
+        {
+            snapshots.push_back(*newest);
+        }
+    }
+
+    return snapshots;
+}
+
+RoomCheckpointFile::Slot* RoomCheckpointFile::GetSlot(int slot) const
+{
+    return reinterpret_cast<Slot*>(mapping + sizeof(FileHeader)) + slot;
+}
+
+const RoomSnapshot* RoomCheckpointFile::GetNewestCopy(int slot) const
+{
+    const RoomSnapshot* newest = nullptr;
+
+    for (const RoomSnapshot& copy : GetSlot(slot)->copies)
+    {
+        bool intact = copy.magic == roomSnapshotMagic && copy.checksum == GetRoomSnapshotChecksum(copy);
+
+        if (intact && (!newest || copy.sequence > newest->sequence))
+        {
+            newest = &copy;
+        }
+    }
+
+    return newest;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CommandQueue.h"
+
+using namespace std;
+
+/*
+    Crash recovery for rooms: every room owns a fixed size slot in a memory-mapped file and the
+    game logic rewrites only the rooms that changed since the last checkpoint. Writes are plain
+    memory copies into shared pages, so a process crash loses nothing the kernel already has.
+
+    Each slot holds two copies of the room. A write always goes to the older copy, and every
+    copy carries a sequence number and a checksum, so a torn write (a crash mid-copy, or
+    someone copying the file while the server runs) leaves the previous copy readable.
+
+    The snapshot is also how rooms move between processes: restoring another shard's file
+    rebuilds its rooms here, waiting for their players to reconnect by username.
+*/
+
+const uint32_t roomSnapshotMagic = 0x4D4F4F52;     // "ROOM"
+const size_t maxSnapshotPlayers = 16;
+
+// A room as plain fixed size data. Rooms with more players keep only the first maxSnapshotPlayers.
+struct RoomSnapshot
+{
+    uint32_t magic = 0;
+    uint32_t checksum = 0;          // over everything after this field
+    uint64_t sequence = 0;
+
+    int32_t roomId = 0;
+    int32_t maxNumber = 0;
+    int32_t numberToGuess = 0;
+    int32_t low = 0;
+    int32_t high = 0;
+    uint8_t gameStarted = 0;
+    uint8_t playerCount = 0;
+    uint8_t activePlayer = 0xFF;    // index into usernames, 0xFF if nobody's turn
+    uint8_t reserved = 0;
+
+    char usernames[maxSnapshotPlayers][maxUsernameLength + 1] = {};
+};
+
+uint32_t GetRoomSnapshotChecksum(const RoomSnapshot& snapshot);
+
+class RoomCheckpointFile
+{
+public:
+    RoomCheckpointFile() {}
+    RoomCheckpointFile(const RoomCheckpointFile&) = delete;
+    RoomCheckpointFile& operator=(const RoomCheckpointFile&) = delete;
+    ~RoomCheckpointFile() { Close(); }
+
+    // Maps the file, creating it if create is set. Existing slots are kept until Reset.
+    bool Open(const string& path, bool create, string& error);
+    void Close();
+    bool IsOpen() const { return mapping != nullptr; }
+
+    // Frees every slot.
+    void Reset();
+
+    // Returns -1 if the file couldn't grow.
+    int AllocateSlot();
+    void FreeSlot(int slot);
+
+    // Writes over the slot's older copy.
+    void WriteSlot(int slot, const RoomSnapshot& snapshot);
+
+    // Starts writing changed pages back to disk. Only needed to survive the OS going down too.
+    void Flush();
+
+    // The newest intact copy of every used slot.
+    vector<RoomSnapshot> ReadSnapshots() const;
+
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t slotCount;
+    };
+
+    struct Slot
+    {
+        RoomSnapshot copies[2];
+    };
+
+    bool OpenFile(bool create, size_t& existingSize);
+    bool Map(size_t slotCount, string& error);
+    void Unmap();
+    Slot* GetSlot(int slot) const;
+    const RoomSnapshot* GetNewestCopy(int slot) const;
+
+    string path;
+    char* mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t slotCount = 0;
+    vector<int> freeSlots;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
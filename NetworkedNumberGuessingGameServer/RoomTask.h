@@ -0,0 +1,166 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+    A room's lifecycle runs as one coroutine (see RunRoom in GameLogic.cpp). It only ever stops
+    at co_await WaitForRoomEvent, naming the events it wants and how long it will wait for them.
+
+    Command handlers hand events to the room (RoomTask::Post), which resumes the coroutine right
+    there if it's waiting for that kind of event and drops the event otherwise. Deadlines go into
+    a RoomTimerQueue that the game logic loop checks every tick. A room that's waiting costs its
+    coroutine frame and at most one queued timer, so any number of them can wait at once.
+
+    Each wait is numbered. A timer left over from a wait that an event already ended doesn't match
+    the room's current wait and is skipped when it comes up.
+*/
+
+enum RoomEventType : uint8_t
+{
+    RE_Timeout = 0,                 // always wanted
+    RE_Guess = 1 << 0,              // the active player guessed
+    RE_ActivePlayerLeft = 1 << 1,   // the turn has already moved on to Room::activePeer
+    RE_PlayerResumed = 1 << 2       // a player of a restored room is back
+};
+
+struct RoomEvent
+{
+    RoomEventType type = RE_Timeout;
+    int number = 0;
+    chrono::steady_clock::time_point time;
+};
+
+struct RoomTimer
+{
+    chrono::steady_clock::time_point time;
+    int roomId;
+    uint64_t wait;
+
+    bool operator>(const RoomTimer& other) const
+    {
+        return time > other.time;
+    }
+};
+
+typedef priority_queue<RoomTimer, vector<RoomTimer>, greater<RoomTimer>> RoomTimerQueue;
+
+class RoomTask
+{
+public:
+    struct promise_type
+    {
+        bool waiting = false;
+        uint8_t wantedEvents = 0;
+        uint64_t wait = 0;
+        RoomEvent event;
+
+        RoomTask get_return_object() { return RoomTask(coroutine_handle<promise_type>::from_promise(*this)); }
+
+        // runs until its first wait as soon as it's called
+        suspend_never initial_suspend() { return {}; }
+
+        // kept until the owner sees it's done, so finishing never frees the frame under a caller
+        suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+
+    // Suspends the lifecycle until one of wantedEvents is posted or deadline passes.
+    struct Awaiter
+    {
+        RoomTimerQueue& timers;
+        int roomId;
+        chrono::steady_clock::time_point deadline;
+        uint8_t wantedEvents;
+        promise_type* promise = nullptr;
+
+        bool await_ready() const { return false; }
+
+        void await_suspend(coroutine_handle<promise_type> handle)
+        {
+            promise = &handle.promise();
+            promise->waiting = true;
+            promise->wantedEvents = wantedEvents;
+            promise->wait++;
+
+            // time_point::max() waits for events alone
+            if (deadline != chrono::steady_clock::time_point::max())
+            {
+                timers.push({ deadline, roomId, promise->wait });
+            }
+        }
+
+        RoomEvent await_resume() const { return promise->event; }
+    };
+
+    RoomTask() = default;
+    RoomTask(const RoomTask&) = delete;
+    RoomTask& operator=(const RoomTask&) = delete;
+
+    RoomTask(RoomTask&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+
+    RoomTask& operator=(RoomTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Destroy();
+            handle = exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~RoomTask()
+    {
+        Destroy();
+    }
+
+    bool IsRunning() const { return handle && !handle.done(); }
+    bool IsDone() const { return handle && handle.done(); }
+
+    // Resumes the lifecycle with event if it's waiting for one of that type. Returns whether it did.
+    bool Post(const RoomEvent& event)
+    {
+        if (!IsRunning() || !handle.promise().waiting
+            || (event.type != RE_Timeout && !(handle.promise().wantedEvents & event.type)))
+        {
+            return false;
+        }
+
+        handle.promise().waiting = false;
+        handle.promise().event = event;
+        handle.resume();
+
+        return true;
+    }
+
+    // A timer is only current if its wait hasn't ended yet.
+    bool IsCurrentWait(uint64_t wait) const
+    {
+        return IsRunning() && handle.promise().waiting && handle.promise().wait == wait;
+    }
+
+private:
+    explicit RoomTask(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    void Destroy()
+    {
+        if (handle)
+        {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+
+    coroutine_handle<promise_type> handle;
+};
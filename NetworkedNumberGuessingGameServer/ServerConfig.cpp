@@ -0,0 +1,109 @@
+#include "ServerConfig.h"
+#include <fstream>
+
+string TrimWhitespace(const string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+
+    if (first == string::npos)
+    {
+        return "";
+    }
+
+    size_t last = text.find_last_not_of(" \t\r");
+
+    return text.substr(first, last - first + 1);
+}
+
+bool ParsePositiveInt(const string& text, int& value)
+{
+    try
+    {
+        size_t parsedLength = 0;
+        int parsed = stoi(text, &parsedLength);
+
+        if (parsedLength != text.length() || parsed <= 0)
+        {
+            return false;
+        }
+
+        value = parsed;
+        return true;
+    }
+    catch (const exception&)
+    {
+        return false;
+    }
+}
+
+bool LoadServerConfig(const string& path, ServerConfig& config, string& error)
+{
+    ifstream file(path);
+
+    if (!file)
+    {
+        error = "could not open " + path;
+        return false;
+    }
+
+    ServerConfig loaded = config;
+    string line;
+    int lineNumber = 0;
+
+    while (getline(file, line))
+    {
+        lineNumber++;
+
+        line = TrimWhitespace(line.substr(0, line.find('#')));
+
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t separator = line.find('=');
+
+        if (separator == string::npos)
+        {
+            error = path + ":" + to_string(lineNumber) + ": expected key = value";
+            return false;
+        }
+
+        string key = TrimWhitespace(line.substr(0, separator));
+        int* setting = nullptr;
+
+        if (key == "maxNumber") setting = &loaded.maxNumber;
+        else if (key == "requiredNumberOfPlayersToBegin") setting = &loaded.requiredNumberOfPlayersToBegin;
+        else if (key == "roomSize") setting = &loaded.roomSize;
+        else if (key == "lobbyTimeout") setting = &loaded.lobbyTimeout;
+        else if (key == "timeToWaitForNextGame") setting = &loaded.timeToWaitForNextGame;
+        else if (key == "drainTimeout") setting = &loaded.drainTimeout;
+        else if (key == "checkpointInterval") setting = &loaded.checkpointInterval;
+        else if (key == "resumeTimeout") setting = &loaded.resumeTimeout;
+        else if (key == "turnTimeout") setting = &loaded.turnTimeout;
+
+        if (!setting)
+        {
+            error = path + ":" + to_string(lineNumber) + ": unknown setting " + key;
+            return false;
+        }
+
+        if (!ParsePositiveInt(TrimWhitespace(line.substr(separator + 1)), *setting))
+        {
+            error = path + ":" + to_string(lineNumber) + ": " + key + " must be a positive integer";
+            return false;
+        }
+    }
+
+    // rooms would form at roomSize, be too small to start and close again every tick
+    if (loaded.roomSize < loaded.requiredNumberOfPlayersToBegin)
+    {
+        error = path + ": roomSize (" + to_string(loaded.roomSize) + ") must be at least requiredNumberOfPlayersToBegin ("
+            + to_string(loaded.requiredNumberOfPlayersToBegin) + ")";
+        return false;
+    }
+
+    config = loaded;
+
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+/*
+    Game rules the server can pick up from a file without restarting.
+    The file is plain "key = value" lines, '#' starts a comment. Unknown keys are rejected
+    so typos don't silently leave a setting at its default. See server.cfg for an example.
+*/
+
+struct ServerConfig
+{
+    int maxNumber = 100;
+    int requiredNumberOfPlayersToBegin = 2;
+    int roomSize = 4;                   // players the lobby tries to put in each room
+    int lobbyTimeout = 10000;           // milliseconds before the lobby settles for a smaller or wider room
+    int timeToWaitForNextGame = 5000;   // milliseconds between rounds
+    int drainTimeout = 30000;           // milliseconds a drain waits for the current round before exiting anyway
+    int checkpointInterval = 1000;      // milliseconds between room checkpoints
+    int resumeTimeout = 30000;          // milliseconds a restored room waits for its players
+    int turnTimeout = 30000;            // milliseconds a player has to guess before the turn passes on
+};
+
+// Returns false and leaves config untouched if the file can't be read, has an invalid line or sets a
+// roomSize smaller than requiredNumberOfPlayersToBegin.
+bool LoadServerConfig(const string& path, ServerConfig& config, string& error);
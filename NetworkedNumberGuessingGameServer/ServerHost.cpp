@@ -0,0 +1,375 @@
+#include "ServerHost.h"
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include "GamePacket.h"
+#include "GameLogic.h"
+#include "TimeSync.h"
+
+using namespace std;
+
+static_assert(atomic<int>::is_always_lock_free && atomic<bool>::is_always_lock_free,
+    "shutdown and reload requests are made from signal handlers");
+
+enet_uint16 serverPort = 1234;
+size_t maxServerPeers = 32;
+
+atomic<int> shutdownRequestCount(0);
+atomic<bool> reloadRequested(false);
+
+ENetAddress address;
+
+// How long the I/O thread blocks in enet_host_service before sending queued outbound packets.
+const int serviceTimeout = 5;
+
+thread gameLogicThread;
+
+filesystem::file_time_type serverConfigWriteTime;
+chrono::steady_clock::time_point nextConfigCheckTime;
+
+void SendOutboundPackets();
+
+bool CreateServer()
+{
+    WriteLocalMessage("Creating server...");
+
+    /* Bind the server to the default localhost.     */
+    /* A specific host address can be specified by   */
+    /* enet_address_set_host (& address, "x.x.x.x"); */
+    address.host = ENET_HOST_ANY;
+    /* Bind the server to serverPort (1234 unless set otherwise). */
+    address.port = serverPort;
+    server = enet_host_create(&address /* the address to bind the server host to */,
+        maxServerPeers /* allow up to 32 clients and/or outgoing connections by default */,
+        2      /* allow up to 2 channels to be used, 0 and 1 */,
+        0      /* assume any amount of incoming bandwidth */,
+        0      /* assume any amount of outgoing bandwidth */);
+
+    return server != NULL;
+}
+
+// ENet clears connectID before reporting a disconnect, so each connection's is kept in peer->data too.
+uint32_t GetPeerConnectId(ENetPeer* peer)
+{
+    return (uint32_t)(uintptr_t)peer->data;
+}
+
+void QueueGameCommand(const GameCommand& command)
+{
+    while (!inboundCommands.TryPush(command))
+    {
+        // the game logic may itself be waiting for room in outboundPackets, so keep those moving
+        SendOutboundPackets();
+        std::this_thread::yield();
+    }
+}
+
+// Answer a clock sync request right here on the I/O thread, so the game logic's queues don't add to the round trip.
+void HandleTimeSyncGamePacket(ENetEvent event, int64_t receiveTime)
+{
+    TimeSyncGamePacket timeSyncGP;
+
+    if (!TimeSyncGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, timeSyncGP))
+    {
+        return;
+    }
+
+    timeSyncGP.serverReceiveTime = receiveTime;
+    timeSyncGP.serverSendTime = GetClockMicroseconds();
+
+    char data[sizeof(TimeSyncGamePacket)];
+    TimeSyncGamePacket::serialize(timeSyncGP, data);
+
+    // unreliable on channel 1: a lost or late sample is better dropped than resent
+    ENetPacket* packet = enet_packet_create(data, timeSyncGP.size(), 0);
+    enet_peer_send(event.peer, 1, packet);
+}
+
+// Decode a received packet into a command on the I/O thread. Anything too short for what it claims to be is dropped.
+void HandleEventTypeReceiveGamePacket(ENetEvent event)
+{
+    if (event.packet->dataLength < GamePacket().size())
+    {
+        return;
+    }
+
+    GamePacket* gamePacket = (GamePacket*)event.packet->data;
+
+    if (gamePacket->type == PHT_TimeSync)
+    {
+        HandleTimeSyncGamePacket(event, GetClockMicroseconds());
+        return;
+    }
+
+    GameCommand command;
+    command.peer = event.peer;
+    command.connectId = GetPeerConnectId(event.peer);
+    command.numberOfConnections = GetNumberOfConnections();
+    command.roundTripTime = event.peer->roundTripTime;
+
+    if (gamePacket->type == PHT_UserInfo)
+    {
+        UserInfoGamePacket userInfoGP;
+
+        if (UserInfoGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, userInfoGP))
+        {
+            command.type = GCT_UserInfo;
+            userInfoGP.username.copy(command.username, maxUsernameLength);
+            command.userInfoFlags = userInfoGP.flags;
+        }
+    }
+    else if (gamePacket->type == PHT_UserGuess)
+    {
+        UserGuessGamePacket userGuessGP;
+
+        if (UserGuessGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, userGuessGP))
+        {
+            command.type = GCT_UserGuess;
+            command.number = userGuessGP.number;
+        }
+    }
+    else if (gamePacket->type == PHT_Subscribe)
+    {
+        SubscribeGamePacket subscribeGP;
+
+        if (SubscribeGamePacket::deserialize((char*)event.packet->data, event.packet->dataLength, subscribeGP))
+        {
+            command.type = GCT_Subscribe;
+            command.subscriptionTopics = subscribeGP.topics;
+        }
+    }
+
+    if (command.type != GCT_Invalid)
+    {
+        QueueGameCommand(command);
+    }
+}
+
+void HandleEventTypeDisconnect(ENetEvent event)
+{
+    int numberOfActiveConnections = GetNumberOfConnections();
+
+    WriteLocalMessage("A peer has disconnected. Connections: " + to_string(numberOfActiveConnections));
+
+    GameCommand command;
+    command.type = GCT_Disconnect;
+    command.peer = event.peer;
+    command.connectId = GetPeerConnectId(event.peer);
+    command.numberOfConnections = numberOfActiveConnections;
+
+    QueueGameCommand(command);
+}
+
+// Send everything the game logic produced since the last tick with a single flush.
+void SendOutboundPackets()
+{
+    OutboundPacket outboundPacket;
+    bool sentPacket = false;
+
+    while (outboundPackets.TryPop(outboundPacket))
+    {
+        // meant for a connection that's gone, whoever has its peer now
+        bool stale = outboundPacket.peer && outboundPacket.connectId != 0
+            && GetPeerConnectId(outboundPacket.peer) != outboundPacket.connectId;
+
+        /* Send the packet over channel id 0. */
+        if (!outboundPacket.packet)
+        {
+            // nothing to send
+        }
+        else
+        {
+            if (stale)
+            {
+                // dropped, only our reference to release
+            }
+            else if (outboundPacket.peer)
+            {
+                enet_peer_send(outboundPacket.peer, 0, outboundPacket.packet);
+            }
+            else
+            {
+                enet_host_broadcast(server, 0, outboundPacket.packet);
+            }
+
+            // ENet now holds its own references for whatever it queued, drop the game logic's
+            if (outboundPacket.releasePacket && --outboundPacket.packet->referenceCount == 0)
+            {
+                enet_packet_destroy(outboundPacket.packet);
+            }
+        }
+
+        if (outboundPacket.disconnect && outboundPacket.peer && !stale)
+        {
+            enet_peer_disconnect_later(outboundPacket.peer, 0);
+        }
+
+        sentPacket = true;
+    }
+
+    if (sentPacket)
+    {
+        enet_host_flush(server);
+    }
+}
+
+// Ask the game logic to reload the config when the file changes or on SIGHUP. Checked once a second.
+void CheckForConfigReload()
+{
+    auto now = chrono::steady_clock::now();
+
+    if (!reloadRequested && now < nextConfigCheckTime)
+    {
+        return;
+    }
+
+    nextConfigCheckTime = now + chrono::seconds(1);
+
+    error_code error;
+    filesystem::file_time_type writeTime = filesystem::last_write_time(serverConfigPath, error);
+    bool fileChanged = !error && writeTime != serverConfigWriteTime;
+
+    if (reloadRequested || fileChanged)
+    {
+        reloadRequested = false;
+        serverConfigWriteTime = writeTime;
+
+        GameCommand command;
+        command.type = GCT_ReloadConfig;
+        command.numberOfConnections = GetNumberOfConnections();
+
+        QueueGameCommand(command);
+    }
+}
+
+// Disconnect everyone and give the disconnects up to 3 seconds to be acknowledged.
+void DisconnectAllPeers()
+{
+    for (size_t i = 0; i < server->peerCount; i++)
+    {
+        if (server->peers[i].state == ENET_PEER_STATE_CONNECTED)
+        {
+            enet_peer_disconnect(&server->peers[i], 0);
+        }
+    }
+
+    ENetEvent event;
+
+    while (GetNumberOfConnections() > 0 && enet_host_service(server, &event, 3000) > 0)
+    {
+        if (event.type == ENET_EVENT_TYPE_RECEIVE)
+        {
+            enet_packet_destroy(event.packet);
+        }
+    }
+}
+
+void RunServer()
+{
+    WriteLocalMessage("Server created. Waiting for connections.");
+
+    // whatever config is loaded now is the one to compare the file against
+    error_code error;
+    serverConfigWriteTime = filesystem::last_write_time(serverConfigPath, error);
+    nextConfigCheckTime = chrono::steady_clock::now() + chrono::seconds(1);
+
+    gameLogicRunning = true;
+    gameLogicThread = thread(RunGameLogic);
+
+    bool draining = false;
+    chrono::steady_clock::time_point drainDeadline;
+
+    while (true)
+    {
+        ENetEvent event;
+
+        /* Wait up to serviceTimeout milliseconds for the first event, then drain the rest without blocking. */
+        int serviceResult = enet_host_service(server, &event, serviceTimeout);
+
+        while (serviceResult > 0)
+        {
+            switch (event.type)
+            {
+            case ENET_EVENT_TYPE_CONNECT:
+            {
+                int numberOfConnections = GetNumberOfConnections();
+
+                WriteLocalMessage("A new peer has connected. Connections: " + to_string(numberOfConnections));
+
+                event.peer->data = (void*)(uintptr_t)event.peer->connectID;
+
+                GameCommand command;
+                command.type = GCT_Connect;
+                command.peer = event.peer;
+                command.connectId = event.peer->connectID;
+                command.numberOfConnections = numberOfConnections;
+
+                QueueGameCommand(command);
+
+                break;
+            }
+            case ENET_EVENT_TYPE_RECEIVE:
+            {
+                HandleEventTypeReceiveGamePacket(event);
+
+                /* Clean up the packet now that we're done using it. */
+                enet_packet_destroy(event.packet);
+
+                break;
+            }
+            case ENET_EVENT_TYPE_DISCONNECT:
+                HandleEventTypeDisconnect(event);
+
+                /* Reset the peer's client information. */
+                event.peer->data = NULL;
+                break;
+            default:
+                break;
+            }
+
+            serviceResult = enet_host_check_events(server, &event);
+        }
+
+        SendOutboundPackets();
+
+        CheckForConfigReload();
+
+        if (shutdownRequestCount > 0 && !draining)
+        {
+            WriteLocalMessage("Shutting down: no new players or rounds, waiting for the current round to finish.");
+
+            draining = true;
+            drainDeadline = chrono::steady_clock::now() + chrono::milliseconds(drainTimeout.load());
+            drainRequested = true;
+        }
+
+        if (draining)
+        {
+            if (gameLogicDrained)
+            {
+                break;
+            }
+
+            if (shutdownRequestCount > 1 || chrono::steady_clock::now() >= drainDeadline)
+            {
+                WriteLocalMessage("Drain deadline reached, stopping the current round.");
+                break;
+            }
+        }
+    }
+
+    gameLogicRunning = false;
+    gameLogicThread.join();
+
+    // the game logic's last messages, then the disconnects
+    SendOutboundPackets();
+    DisconnectAllPeers();
+    CloseRoomCheckpoint();
+
+    WriteLocalMessage("Server stopped.");
+
+    if (server != NULL) enet_host_destroy(server);
+
+    server = NULL;
+}
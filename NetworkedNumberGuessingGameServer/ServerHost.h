@@ -0,0 +1,27 @@
+#pragma once
+
+#include <enet/enet.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+/*
+    The server's I/O thread: owns the ENet host, turns its events into GameCommands for the game
+    logic thread and sends whatever the game logic queued back. main.cpp sets the server up and
+    calls RunServer; the soak harness runs the same loop in-process against its own bots.
+*/
+
+// Set before CreateServer.
+extern enet_uint16 serverPort;
+extern size_t maxServerPeers;
+
+// First request starts a drain, a second one stops right away. Lock-free, so signal handlers can bump it.
+extern atomic<int> shutdownRequestCount;
+extern atomic<bool> reloadRequested;
+
+bool CreateServer();
+
+// Runs the game logic thread and the I/O loop until a shutdown request, then disconnects everyone and destroys the host.
+void RunServer();
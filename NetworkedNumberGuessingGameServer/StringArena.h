@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+/*
+    Interned short strings (usernames, message dictionary words) in fixed size slots.
+
+    Every distinct string is stored once however many players or dictionaries use it, and is
+    named by its slot number. Slots are reference counted and reused once the last reference is
+    released. Lookup is an open addressing table of slot numbers (linear probing, backward shift
+    deletion), so nothing holds a pointer into the slots and they can grow freely.
+
+    Strings longer than maxInternedStringLength don't fit; Intern returns invalidStringId for them.
+*/
+
+typedef uint32_t StringId;
+
+const StringId invalidStringId = UINT32_MAX;
+const size_t stringSlotSize = 32;
+const size_t maxInternedStringLength = stringSlotSize - 1;
+
+class StringArena
+{
+public:
+    StringArena() : table(16, invalidStringId) {}
+
+    // Takes a reference to text, interning it first if needed.
+    StringId Intern(string_view text)
+    {
+        if (text.size() > maxInternedStringLength)
+        {
+            return invalidStringId;
+        }
+
+        uint32_t hash = Hash(text);
+        size_t position = FindPosition(text, hash);
+
+        if (table[position] != invalidStringId)
+        {
+            referenceCounts[table[position]]++;
+            return table[position];
+        }
+
+        StringId id;
+
+        if (!freeSlots.empty())
+        {
+            id = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            id = (StringId)slots.size();
+            slots.emplace_back();
+            referenceCounts.push_back(0);
+        }
+
+        Slot& slot = slots[id];
+        slot.length = (uint8_t)text.size();
+        memcpy(slot.text, text.data(), text.size());
+
+        referenceCounts[id] = 1;
+        table[position] = id;
+        stringCount++;
+
+        // keep the table at most half full
+        if (stringCount * 2 > table.size())
+        {
+            Rehash(table.size() * 2);
+        }
+
+        return id;
+    }
+
+    // The id of text if it's interned, without taking a reference.
+    StringId Find(string_view text) const
+    {
+        if (text.size() > maxInternedStringLength)
+        {
+            return invalidStringId;
+        }
+
+        return table[FindPosition(text, Hash(text))];
+    }
+
+    void AddReference(StringId id)
+    {
+        referenceCounts[id]++;
+    }
+
+    void Release(StringId id)
+    {
+        if (id == invalidStringId || --referenceCounts[id] != 0)
+        {
+            return;
+        }
+
+        size_t mask = table.size() - 1;
+        size_t hole = FindPosition(Get(id), Hash(Get(id)));
+
+        // pull later entries of the same probe run back over the hole
+        for (size_t next = (hole + 1) & mask; table[next] != invalidStringId; next = (next + 1) & mask)
+        {
+            size_t home = Hash(Get(table[next])) & mask;
+
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                table[hole] = table[next];
+                hole = next;
+            }
+        }
+
+        table[hole] = invalidStringId;
+        freeSlots.push_back(id);
+        stringCount--;
+    }
+
+    string_view Get(StringId id) const
+    {
+        if (id == invalidStringId)
+        {
+            return string_view();
+        }
+
+        return string_view(slots[id].text, slots[id].length);
+    }
+
+    size_t Size() const
+    {
+        return stringCount;
+    }
+
+    size_t MemoryUsage() const
+    {
+        return slots.capacity() * sizeof(Slot) + referenceCounts.capacity() * sizeof(uint32_t)
+            + table.capacity() * sizeof(StringId) + freeSlots.capacity() * sizeof(StringId);
+    }
+
+private:
+    struct Slot
+    {
+        uint8_t length;
+        char text[maxInternedStringLength];
+    };
+
+    static uint32_t Hash(string_view text)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+
+        for (char c : text)
+        {
+            hash = (hash ^ (uint8_t)c) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    // Where text is in the table, or the empty entry where it would go.
+    size_t FindPosition(string_view text, uint32_t hash) const
+    {
+        size_t mask = table.size() - 1;
+        size_t position = hash & mask;
+
+        while (table[position] != invalidStringId && Get(table[position]) != text)
+        {
+            position = (position + 1) & mask;
+        }
+
+        return position;
+    }
+
+    void Rehash(size_t newSize)
+    {
+        vector<StringId> oldTable(newSize, invalidStringId);
+        oldTable.swap(table);
+
+        for (StringId id : oldTable)
+        {
+            if (id != invalidStringId)
+            {
+                table[FindPosition(Get(id), Hash(Get(id)))] = id;
+            }
+        }
+    }
+
+    vector<Slot> slots;
+    vector<uint32_t> referenceCounts;
+    vector<StringId> table;
+    vector<StringId> freeSlots;
+    size_t stringCount = 0;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include "GamePacket.h"
+
+using namespace std;
+
+/*
+    Clock sync and latency telemetry shared by the server, the client and the bot.
+
+    The client sends a TimeSyncGamePacket with its clock, the server's I/O thread fills in when
+    it received and sent it back, and the client stamps the reply's arrival (NTP's four times):
+
+        offset     = ((serverReceiveTime - clientSendTime) + (serverSendTime - clientReceiveTime)) / 2
+        round trip = (clientReceiveTime - clientSendTime) - (serverSendTime - serverReceiveTime)
+
+    Queueing only ever makes a round trip longer and the offset less accurate, so ClockSync keeps
+    the last few samples and trusts the one with the shortest round trip.
+
+    All times are microseconds on each process's own steady clock (GetClockMicroseconds).
+*/
+
+inline int64_t GetClockMicroseconds()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// "12.3ms"
+inline string FormatMilliseconds(double microseconds)
+{
+    string text = to_string(microseconds / 1000.0);
+    return text.substr(0, text.find('.') + 2) + "ms";
+}
+
+struct TimeSyncGamePacket : GamePacket
+{
+    TimeSyncGamePacket()
+    {
+        type = PHT_TimeSync;
+    }
+
+    int64_t clientSendTime = 0;
+    int64_t serverReceiveTime = 0;
+    int64_t serverSendTime = 0;
+
+    size_t size() const
+    {
+        return GamePacket::size() + sizeof(clientSendTime) + sizeof(serverReceiveTime) + sizeof(serverSendTime);
+    }
+
+    static void serialize(const TimeSyncGamePacket& aTimeSyncGamePacket, char* data)
+    {
+        size_t bufferIdx = GamePacket::serialize(aTimeSyncGamePacket, data);
+
+        memcpy(&data[bufferIdx], &aTimeSyncGamePacket.clientSendTime, sizeof(clientSendTime));
+        bufferIdx += sizeof(clientSendTime);
+        memcpy(&data[bufferIdx], &aTimeSyncGamePacket.serverReceiveTime, sizeof(serverReceiveTime));
+        bufferIdx += sizeof(serverReceiveTime);
+        memcpy(&data[bufferIdx], &aTimeSyncGamePacket.serverSendTime, sizeof(serverSendTime));
+    }
+
+    static bool deserialize(const char* data, size_t dataLength, TimeSyncGamePacket& aTimeSyncGamePacket)
+    {
+        if (dataLength < aTimeSyncGamePacket.size())
+        {
+            return false;
+        }
+
+        size_t buffIdx = GamePacket().size();
+
+        memcpy(&aTimeSyncGamePacket.clientSendTime, &data[buffIdx], sizeof(clientSendTime));
+        buffIdx += sizeof(clientSendTime);
+        memcpy(&aTimeSyncGamePacket.serverReceiveTime, &data[buffIdx], sizeof(serverReceiveTime));
+        buffIdx += sizeof(serverReceiveTime);
+        memcpy(&aTimeSyncGamePacket.serverSendTime, &data[buffIdx], sizeof(serverSendTime));
+
+        return true;
+    }
+};
+
+const size_t clockSyncSampleCount = 8;
+
+// Ping quickly until there are enough samples to filter, then only often enough to follow drift.
+const int64_t clockSyncFastInterval = 250000;
+const int64_t clockSyncInterval = 2000000;
+
+// Client side estimate of the server's clock.
+struct ClockSync
+{
+    struct Sample
+    {
+        int64_t offset = 0;         // server clock minus client clock
+        int64_t roundTripTime = 0;
+    };
+
+    Sample samples[clockSyncSampleCount];
+    size_t sampleCount = 0;
+    size_t nextSample = 0;
+    size_t bestSample = 0;
+    int64_t lastRequestTime = 0;
+
+    bool IsSynced() const
+    {
+        return sampleCount > 0;
+    }
+
+    // Whether it's time for another TimeSyncGamePacket. Remembers now as the time of the request if so.
+    bool IsRequestDue(int64_t now)
+    {
+        int64_t interval = sampleCount < clockSyncSampleCount ? clockSyncFastInterval : clockSyncInterval;
+
+        if (lastRequestTime != 0 && now - lastRequestTime < interval)
+        {
+            return false;
+        }
+
+        lastRequestTime = now;
+        return true;
+    }
+
+    void AddSample(const TimeSyncGamePacket& reply, int64_t clientReceiveTime)
+    {
+        Sample sample;
+        sample.offset = ((reply.serverReceiveTime - reply.clientSendTime) + (reply.serverSendTime - clientReceiveTime)) / 2;
+        sample.roundTripTime = max<int64_t>(0, (clientReceiveTime - reply.clientSendTime) - (reply.serverSendTime - reply.serverReceiveTime));
+
+        samples[nextSample] = sample;
+        nextSample = (nextSample + 1) % clockSyncSampleCount;
+        sampleCount = min(sampleCount + 1, clockSyncSampleCount);
+
+        bestSample = 0;
+
+        for (size_t i = 1; i < sampleCount; i++)
+        {
+            if (samples[i].roundTripTime < samples[bestSample].roundTripTime) bestSample = i;
+        }
+    }
+
+    int64_t GetOffset() const
+    {
+        return IsSynced() ? samples[bestSample].offset : 0;
+    }
+
+    int64_t GetRoundTripTime() const
+    {
+        return IsSynced() ? samples[bestSample].roundTripTime : 0;
+    }
+
+    int64_t ToClientTime(int64_t serverTime) const
+    {
+        return serverTime - GetOffset();
+    }
+
+    // "clock offset=-3.2ms rtt=1.1ms"
+    string Format() const
+    {
+        if (!IsSynced())
+        {
+            return "clock unsynced";
+        }
+
+        return "clock offset=" + FormatMilliseconds((double)GetOffset()) + " rtt=" + FormatMilliseconds((double)GetRoundTripTime());
+    }
+};
+
+// Count, range, mean and jitter of a stream of latencies in microseconds.
+// Jitter is smoothed the way RTP does it (RFC 3550): 1/16 of each change between consecutive samples.
+struct LatencyStats
+{
+    uint64_t count = 0;
+    int64_t minimum = numeric_limits<int64_t>::max();
+    int64_t maximum = 0;
+    int64_t total = 0;
+    int64_t last = 0;
+    double jitter = 0;
+
+    void Add(int64_t latency)
+    {
+        latency = max<int64_t>(0, latency);
+
+        if (count > 0)
+        {
+            jitter += ((double)llabs(latency - last) - jitter) / 16.0;
+        }
+
+        count++;
+        minimum = min(minimum, latency);
+        maximum = max(maximum, latency);
+        total += latency;
+        last = latency;
+    }
+
+    int64_t GetMean() const
+    {
+        return count > 0 ? total / (int64_t)count : 0;
+    }
+
+    // "name count=3 min=1.2ms mean=1.5ms max=2.0ms jitter=0.3ms", or just the count before any samples.
+    string Format(const string& name) const
+    {
+        string text = name + " count=" + to_string(count);
+
+        if (count > 0)
+        {
+            text += " min=" + FormatMilliseconds((double)minimum) + " mean=" + FormatMilliseconds((double)GetMean())
+                + " max=" + FormatMilliseconds((double)maximum) + " jitter=" + FormatMilliseconds(jitter);
+        }
+
+        return text;
+    }
+};
@@ -0,0 +1,969 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include <enet/enet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GamePacket.h"
+#include "GameLogic.h"
+#include "MessageBatch.h"
+#include "ServerHost.h"
+#include "TimeSync.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <unistd.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+/*
+    Soak and chaos test. Runs the server in this process along with botCount bots, all of them on
+    one ENet client host, and passes every datagram between the two through a proxy that drops,
+    delays, reorders and duplicates them. Bots also leave and come back (churn), half of them
+    cleanly and half by just going quiet so the server has to time them out, and every
+    stormInterval seconds all of them do at once and reconnect together.
+
+    Usage: NetworkedNumberGuessingGameSoak [--duration 3600] [--bots 64] ..., see PrintUsage for the rest.
+
+    A report line goes out every reportInterval seconds. At the end the run is checked against
+    its SLOs, counting only the report intervals after the warm-up:
+    - guess results per second across all bots, and no report interval without any
+    - p99 latency from a bot sending its guess to the result arriving
+    - resident memory growth since the warm-up
+    - no message batch a bot couldn't decode
+    - players, rooms and the lobby agreeing with each other once the server has stopped (CheckGameState)
+    Exits with EXIT_FAILURE if any of them is missed.
+*/
+
+int durationSeconds = 60;
+int warmUpSeconds = 10;
+int reportIntervalSeconds = 10;
+int botCount = 64;
+unsigned int randomSeed = 0;
+bool serverLog = false;
+
+// Link conditions, applied to each direction on its own.
+double lossRate = 0.02;
+int delayMilliseconds = 20;
+int jitterMilliseconds = 10;
+double reorderRate = 0.01;          // held back long enough for the datagrams after it to overtake it
+double duplicateRate = 0.005;
+
+double churnRate = 0.01;            // chance per second that a bot leaves
+int stormIntervalSeconds = 0;       // 0 for no reconnect storms
+
+double minGuessesPerSecond = 5.0;
+int maxResultP99Milliseconds = 1000;
+int maxMemoryGrowthMegabytes = 64;
+
+// The server's logging goes to cout and is muted unless --server-log; reports go to stdout through here.
+ostream report(cout.rdbuf());
+
+const int64_t microsecondsPerSecond = 1000000;
+
+// Guess to result latencies in 1ms buckets. Anything slower lands in the last one.
+const size_t latencyBucketCount = 10000;
+
+struct LatencyHistogram
+{
+    vector<uint64_t> buckets = vector<uint64_t>(latencyBucketCount, 0);
+    uint64_t count = 0;
+    int64_t maximum = 0;
+
+    void Add(int64_t latency)
+    {
+        latency = max<int64_t>(0, latency);
+
+        buckets[min<size_t>((size_t)(latency / 1000), latencyBucketCount - 1)]++;
+        count++;
+        maximum = max(maximum, latency);
+    }
+
+    void Merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < latencyBucketCount; i++)
+        {
+            buckets[i] += other.buckets[i];
+        }
+
+        count += other.count;
+        maximum = max(maximum, other.maximum);
+    }
+
+    // In milliseconds, the upper edge of the bucket the percentile falls in.
+    int64_t GetPercentile(double percentile) const
+    {
+        uint64_t rank = count > 0 ? (uint64_t)ceil(percentile / 100.0 * (double)count) - 1 : 0;
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < latencyBucketCount; i++)
+        {
+            seen += buckets[i];
+
+            if (seen > rank)
+            {
+                return (int64_t)i + 1;
+            }
+        }
+
+        return count > 0 ? (int64_t)latencyBucketCount : 0;
+    }
+};
+
+// What the bots saw. Only touched by the main thread.
+struct SoakCounters
+{
+    uint64_t connects = 0;
+    uint64_t connectFailures = 0;
+    uint64_t serverDisconnects = 0;
+    uint64_t churnLeaves = 0;
+    uint64_t prompts = 0;
+    uint64_t guessResults = 0;
+    uint64_t roundsWon = 0;
+    uint64_t malformedBatches = 0;
+    LatencyHistogram resultLatency;
+
+    void Merge(const SoakCounters& other)
+    {
+        connects += other.connects;
+        connectFailures += other.connectFailures;
+        serverDisconnects += other.serverDisconnects;
+        churnLeaves += other.churnLeaves;
+        prompts += other.prompts;
+        guessResults += other.guessResults;
+        roundsWon += other.roundsWon;
+        malformedBatches += other.malformedBatches;
+        resultLatency.Merge(other.resultLatency);
+    }
+};
+
+SoakCounters intervalCounters;
+SoakCounters measuredCounters;      // everything after the warm-up
+
+/* Chaos proxy */
+
+// The bots connect here; the proxy forwards from its second socket to the server's port.
+enet_uint16 proxyPort = 0;
+
+ENetSocket proxyClientSocket = ENET_SOCKET_NULL;
+ENetSocket proxyServerSocket = ENET_SOCKET_NULL;
+ENetAddress proxyServerAddress;
+
+thread proxyThread;
+atomic<bool> proxyRunning;
+
+atomic<uint64_t> datagramsForwarded;
+atomic<uint64_t> datagramsDropped;
+atomic<uint64_t> datagramsReordered;
+atomic<uint64_t> datagramsDuplicated;
+
+// Larger than any datagram ENet sends (ENET_PROTOCOL_MAXIMUM_MTU).
+const size_t maxDatagramSize = 4096;
+
+struct Datagram
+{
+    int64_t sendTime = 0;
+    uint64_t sequence = 0;          // keeps datagrams due at the same time in arrival order
+    bool toServer = false;
+    vector<uint8_t> data;
+
+    bool operator>(const Datagram& other) const
+    {
+        return sendTime != other.sendTime ? sendTime > other.sendTime : sequence > other.sequence;
+    }
+};
+
+bool CreateProxy()
+{
+    ENetAddress clientSideAddress;
+    clientSideAddress.host = ENET_HOST_ANY;
+    clientSideAddress.port = proxyPort;
+
+    proxyClientSocket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+    proxyServerSocket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+
+    if (proxyClientSocket == ENET_SOCKET_NULL || proxyServerSocket == ENET_SOCKET_NULL
+        || enet_socket_bind(proxyClientSocket, &clientSideAddress) < 0)
+    {
+        return false;
+    }
+
+    // any free port toward the server
+    ENetAddress serverSideAddress;
+    serverSideAddress.host = ENET_HOST_ANY;
+    serverSideAddress.port = 0;
+
+    if (enet_socket_bind(proxyServerSocket, &serverSideAddress) < 0)
+    {
+        return false;
+    }
+
+    enet_socket_set_option(proxyClientSocket, ENET_SOCKOPT_NONBLOCK, 1);
+    enet_socket_set_option(proxyServerSocket, ENET_SOCKOPT_NONBLOCK, 1);
+
+    // the bots' bursts after a storm would overflow the default buffers before the proxy gets to them
+    enet_socket_set_option(proxyClientSocket, ENET_SOCKOPT_RCVBUF, 4 * 1024 * 1024);
+    enet_socket_set_option(proxyServerSocket, ENET_SOCKOPT_RCVBUF, 4 * 1024 * 1024);
+
+    enet_address_set_host(&proxyServerAddress, "127.0.0.1");
+    proxyServerAddress.port = serverPort;
+
+    return true;
+}
+
+void DestroyProxy()
+{
+    if (proxyClientSocket != ENET_SOCKET_NULL) enet_socket_destroy(proxyClientSocket);
+    if (proxyServerSocket != ENET_SOCKET_NULL) enet_socket_destroy(proxyServerSocket);
+}
+
+// Proxy thread. Every datagram that isn't lost is queued with its own delay, so jitter reorders
+// them too. Sending is the only thing that looks at the queue, once per pass.
+void RunChaosProxy()
+{
+    mt19937 randomEngine(randomSeed + 1);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    uniform_int_distribution<int> jitter(0, max(0, jitterMilliseconds));
+
+    priority_queue<Datagram, vector<Datagram>, greater<Datagram>> inFlight;
+    uint64_t nextSequence = 0;
+
+    // every bot shares one client host, so there's a single address to send back to
+    ENetAddress clientAddress = {};
+    bool haveClientAddress = false;
+
+    vector<uint8_t> buffer(maxDatagramSize);
+
+    auto schedule = [&](bool toServer, size_t length, int64_t now)
+    {
+        if (chance(randomEngine) < lossRate)
+        {
+            datagramsDropped++;
+            return;
+        }
+
+        int64_t delay = (int64_t)(delayMilliseconds + jitter(randomEngine)) * 1000;
+
+        if (chance(randomEngine) < reorderRate)
+        {
+            delay += (int64_t)(delayMilliseconds + jitterMilliseconds + 5) * 1000;
+            datagramsReordered++;
+        }
+
+        Datagram datagram;
+        datagram.sendTime = now + delay;
+        datagram.sequence = nextSequence++;
+        datagram.toServer = toServer;
+        datagram.data.assign(buffer.begin(), buffer.begin() + length);
+
+        if (chance(randomEngine) < duplicateRate)
+        {
+            Datagram duplicate = datagram;
+            duplicate.sendTime += (int64_t)jitter(randomEngine) * 1000;
+            duplicate.sequence = nextSequence++;
+            inFlight.push(move(duplicate));
+            datagramsDuplicated++;
+        }
+
+        inFlight.push(move(datagram));
+    };
+
+    while (proxyRunning)
+    {
+        bool received = false;
+        int64_t now = GetClockMicroseconds();
+
+        for (bool toServer : { true, false })
+        {
+            ENetSocket socket = toServer ? proxyClientSocket : proxyServerSocket;
+
+            while (true)
+            {
+                ENetAddress from;
+                ENetBuffer receiveBuffer;
+                receiveBuffer.data = buffer.data();
+                receiveBuffer.dataLength = buffer.size();
+
+                // 0 when there's nothing left to read
+                int length = enet_socket_receive(socket, &from, &receiveBuffer, 1);
+
+                if (length <= 0)
+                {
+                    break;
+                }
+
+                received = true;
+
+                if (toServer)
+                {
+                    clientAddress = from;
+                    haveClientAddress = true;
+                }
+                else if (from.port != proxyServerAddress.port)
+                {
+                    continue;
+                }
+
+                schedule(toServer, (size_t)length, now);
+            }
+        }
+
+        while (!inFlight.empty() && inFlight.top().sendTime <= now)
+        {
+            const Datagram& datagram = inFlight.top();
+
+            ENetBuffer sendBuffer;
+            sendBuffer.data = (void*)datagram.data.data();
+            sendBuffer.dataLength = datagram.data.size();
+
+            if (datagram.toServer)
+            {
+                enet_socket_send(proxyServerSocket, &proxyServerAddress, &sendBuffer, 1);
+                datagramsForwarded++;
+            }
+            else if (haveClientAddress)
+            {
+                enet_socket_send(proxyClientSocket, &clientAddress, &sendBuffer, 1);
+                datagramsForwarded++;
+            }
+
+            inFlight.pop();
+        }
+
+        if (!received)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+}
+
+/* Bots */
+
+struct SoakBot
+{
+    string username;
+    ENetPeer* peer = nullptr;       // null while offline
+    bool joined = false;            // connected and sent its UserInfo
+    int64_t reconnectTime = 0;      // while offline
+
+    int knownLow = 0;
+    int knownHigh = 0;
+    int64_t guessSendTime = 0;
+
+    MessageDecoder messageDecoder;
+};
+
+ENetHost* botHost = nullptr;
+ENetAddress proxyAddress;
+vector<SoakBot> bots;
+
+mt19937 randomEngine;
+string messageBatchText;
+vector<string_view> messageBatchMessages;
+
+void SendBotPacket(SoakBot& bot, const char* data, size_t dataSize)
+{
+    enet_peer_send(bot.peer, 0, enet_packet_create(data, dataSize, ENET_PACKET_FLAG_RELIABLE));
+}
+
+void SendUserInfo(SoakBot& bot, uint8_t flags)
+{
+    UserInfoGamePacket userInfoGP;
+    userInfoGP.username = bot.username;
+    userInfoGP.flags = flags;
+
+    vector<char> data(userInfoGP.size());
+    UserInfoGamePacket::serialize(userInfoGP, data.data());
+
+    SendBotPacket(bot, data.data(), data.size());
+}
+
+void SendSubscribe(SoakBot& bot, uint8_t topics)
+{
+    SubscribeGamePacket subscribeGP;
+    subscribeGP.topics = topics;
+
+    vector<char> data(subscribeGP.size());
+    SubscribeGamePacket::serialize(subscribeGP, data.data());
+
+    SendBotPacket(bot, data.data(), data.size());
+}
+
+void SendGuess(SoakBot& bot, int number)
+{
+    UserGuessGamePacket userGuessGP;
+    userGuessGP.number = number;
+
+    vector<char> data(userGuessGP.size());
+    UserGuessGamePacket::serialize(userGuessGP, data.data());
+
+    bot.guessSendTime = GetClockMicroseconds();
+
+    SendBotPacket(bot, data.data(), data.size());
+}
+
+void ConnectBot(size_t index)
+{
+    SoakBot& bot = bots[index];
+
+    bot.peer = enet_host_connect(botHost, &proxyAddress, 2, 0);
+
+    // every peer of the client host is still busy, try again shortly
+    if (!bot.peer)
+    {
+        bot.reconnectTime = GetClockMicroseconds() + microsecondsPerSecond / 10;
+        return;
+    }
+
+    bot.peer->data = (void*)(uintptr_t)(index + 1);
+    bot.joined = false;
+    bot.knownLow = 0;
+    bot.knownHigh = 0;
+    bot.guessSendTime = 0;
+    bot.messageDecoder = MessageDecoder();
+}
+
+// Leave either cleanly or by going quiet, which the server only notices once ENet times the connection out.
+void DisconnectBot(SoakBot& bot, int64_t reconnectDelay)
+{
+    if (bot.peer)
+    {
+        if (randomEngine() % 2 == 0)
+        {
+            enet_peer_disconnect(bot.peer, 0);
+        }
+        else
+        {
+            enet_peer_reset(bot.peer);
+        }
+    }
+
+    bot.peer = nullptr;
+    bot.joined = false;
+    bot.reconnectTime = GetClockMicroseconds() + reconnectDelay;
+}
+
+// Even bots take message batches and every third one only subscribes to what it needs, so all the send paths get traffic.
+void HandleBotConnect(size_t index)
+{
+    SoakBot& bot = bots[index];
+
+    SendUserInfo(bot, index % 2 == 0 ? UIF_MessageBatch : 0);
+
+    if (index % 3 == 0)
+    {
+        SendSubscribe(bot, ST_Room | ST_Results);
+    }
+
+    bot.joined = true;
+    intervalCounters.connects++;
+}
+
+// Binary search the known range like NetworkedNumberGuessingGameBot does, or guess at random before any hints.
+void HandlePrompt(SoakBot& bot, const ENetPacket* packet)
+{
+    UserGuessGamePacket userGuessGP;
+    UserGuessGamePacket::deserialize((char*)packet->data, packet->dataLength, userGuessGP);
+
+    intervalCounters.prompts++;
+
+    int maxNumber = userGuessGP.number > 0 ? userGuessGP.number : 1;
+
+    if (bot.knownHigh >= bot.knownLow && bot.knownLow >= 1 && bot.knownHigh <= maxNumber)
+    {
+        SendGuess(bot, bot.knownLow + (bot.knownHigh - bot.knownLow) / 2);
+        return;
+    }
+
+    uniform_int_distribution<int> guessDistribution(1, maxNumber);
+    SendGuess(bot, guessDistribution(randomEngine));
+}
+
+void HandleGuessResult(SoakBot& bot, const ENetPacket* packet)
+{
+    GuessResultGamePacket guessResultGP;
+    GuessResultGamePacket::deserialize((char*)packet->data, packet->dataLength, guessResultGP);
+
+    // the result of our own guess
+    if (bot.guessSendTime != 0)
+    {
+        intervalCounters.resultLatency.Add(GetClockMicroseconds() - bot.guessSendTime);
+        intervalCounters.guessResults++;
+        intervalCounters.roundsWon += guessResultGP.hint == GH_Correct ? 1 : 0;
+
+        bot.guessSendTime = 0;
+    }
+
+    if (guessResultGP.hint == GH_Correct)
+    {
+        bot.knownLow = 0;
+        bot.knownHigh = 0;
+    }
+    else
+    {
+        bot.knownLow = guessResultGP.low;
+        bot.knownHigh = guessResultGP.high;
+    }
+}
+
+void HandleBotReceive(SoakBot& bot, const ENetPacket* packet)
+{
+    GamePacket* gamePacket = (GamePacket*)packet->data;
+
+    if (!gamePacket)
+    {
+        return;
+    }
+
+    if (gamePacket->type == PHT_UserGuess)
+    {
+        HandlePrompt(bot, packet);
+    }
+    else if (gamePacket->type == PHT_GuessResult)
+    {
+        HandleGuessResult(bot, packet);
+    }
+    else if (gamePacket->type == PHT_MessageBatch)
+    {
+        // decoded even though nobody reads them, so the bot's dictionary follows the server's
+        if (!MessageBatchGamePacket::deserialize((char*)packet->data, packet->dataLength,
+            bot.messageDecoder, messageBatchText, messageBatchMessages))
+        {
+            intervalCounters.malformedBatches++;
+        }
+    }
+}
+
+// Service the bots' host until nothing is left to do right now, waiting up to timeout for the first event.
+void ServiceBots(enet_uint32 timeout)
+{
+    ENetEvent event;
+    int serviceResult = enet_host_service(botHost, &event, timeout);
+
+    while (serviceResult > 0)
+    {
+        size_t index = (size_t)(uintptr_t)event.peer->data - 1;
+
+        // events for a connection the bot has already walked away from
+        bool current = index < bots.size() && bots[index].peer == event.peer;
+
+        switch (event.type)
+        {
+        case ENET_EVENT_TYPE_CONNECT:
+            if (current)
+            {
+                HandleBotConnect(index);
+            }
+            break;
+        case ENET_EVENT_TYPE_RECEIVE:
+            if (current)
+            {
+                HandleBotReceive(bots[index], event.packet);
+            }
+
+            enet_packet_destroy(event.packet);
+            break;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            if (current)
+            {
+                if (bots[index].joined)
+                {
+                    intervalCounters.serverDisconnects++;
+                }
+                else
+                {
+                    intervalCounters.connectFailures++;
+                }
+
+                bots[index].peer = nullptr;
+                bots[index].joined = false;
+                bots[index].reconnectTime = GetClockMicroseconds() + microsecondsPerSecond;
+            }
+            break;
+        default:
+            break;
+        }
+
+        serviceResult = enet_host_check_events(botHost, &event);
+    }
+}
+
+// Churn is checked every churnCheckInterval; a storm takes everyone down and brings them back within a second or two.
+const int64_t churnCheckInterval = microsecondsPerSecond / 10;
+
+void UpdateChurn(int64_t now, bool storm)
+{
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    uniform_int_distribution<int64_t> reconnectDelay(microsecondsPerSecond / 10, 2 * microsecondsPerSecond);
+
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        SoakBot& bot = bots[i];
+
+        if (!bot.peer)
+        {
+            if (now >= bot.reconnectTime)
+            {
+                ConnectBot(i);
+            }
+
+            continue;
+        }
+
+        if (bot.joined && (storm || chance(randomEngine) < churnRate * churnCheckInterval / microsecondsPerSecond))
+        {
+            DisconnectBot(bot, reconnectDelay(randomEngine));
+            intervalCounters.churnLeaves++;
+        }
+    }
+}
+
+/* Report */
+
+// Resident set size in bytes, or 0 where we can't tell.
+size_t GetResidentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.WorkingSetSize;
+    }
+
+    return 0;
+#elif defined(__linux__)
+    ifstream statm("/proc/self/statm");
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+
+    if (!(statm >> totalPages >> residentPages))
+    {
+        return 0;
+    }
+
+    return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    // only the peak is portable; growth still shows
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (size_t)usage.ru_maxrss;
+#endif
+}
+
+string FormatMegabytes(size_t bytes)
+{
+    string text = to_string((double)bytes / (1024.0 * 1024.0));
+    return text.substr(0, text.find('.') + 2) + "MB";
+}
+
+size_t CountJoinedBots()
+{
+    return (size_t)count_if(bots.begin(), bots.end(), [](const SoakBot& bot) { return bot.joined; });
+}
+
+void WriteReport(int64_t elapsed, int64_t interval)
+{
+    const SoakCounters& counters = intervalCounters;
+    double seconds = (double)interval / microsecondsPerSecond;
+
+    report << "[soak] " << elapsed / microsecondsPerSecond << "s"
+        << " bots=" << CountJoinedBots() << "/" << bots.size()
+        << " connects=" << counters.connects
+        << " failed=" << counters.connectFailures
+        << " dropped-by-server=" << counters.serverDisconnects
+        << " churned=" << counters.churnLeaves
+        << " guesses/s=" << (int64_t)(counters.guessResults / seconds)
+        << " rounds=" << counters.roundsWon
+        << " result p50=" << counters.resultLatency.GetPercentile(50) << "ms"
+        << " p99=" << counters.resultLatency.GetPercentile(99) << "ms"
+        << " max=" << FormatMilliseconds((double)counters.resultLatency.maximum)
+        << " rss=" << FormatMegabytes(GetResidentMemory())
+        << " link forwarded=" << datagramsForwarded
+        << " lost=" << datagramsDropped
+        << " reordered=" << datagramsReordered
+        << " duplicated=" << datagramsDuplicated << endl;
+}
+
+// Print what missed its SLO. Returns whether everything passed.
+bool CheckResults(int64_t measuredTime, size_t warmUpMemory, size_t finalMemory, uint64_t stalledIntervals, const string& stateError)
+{
+    bool passed = true;
+
+    auto check = [&](bool ok, const string& description)
+    {
+        report << "[soak] " << (ok ? "PASS " : "FAIL ") << description << endl;
+        passed = passed && ok;
+    };
+
+    double seconds = max(1.0, (double)measuredTime / microsecondsPerSecond);
+    double guessesPerSecond = measuredCounters.guessResults / seconds;
+    int64_t resultP99 = measuredCounters.resultLatency.GetPercentile(99);
+
+    check(guessesPerSecond >= minGuessesPerSecond,
+        "throughput " + to_string((int64_t)guessesPerSecond) + " guesses/s (minimum " + to_string((int64_t)minGuessesPerSecond) + ")");
+    check(stalledIntervals == 0, to_string(stalledIntervals) + " report intervals without a single guess result");
+    check(measuredCounters.resultLatency.count > 0 && resultP99 <= maxResultP99Milliseconds,
+        "guess to result p99 " + to_string(resultP99) + "ms (maximum " + to_string(maxResultP99Milliseconds) + "ms)");
+
+    if (warmUpMemory == 0 || finalMemory == 0)
+    {
+        report << "[soak] SKIP memory growth, resident memory isn't available here" << endl;
+    }
+    else
+    {
+        size_t growth = finalMemory > warmUpMemory ? finalMemory - warmUpMemory : 0;
+
+        check(growth <= (size_t)maxMemoryGrowthMegabytes * 1024 * 1024,
+            "memory growth " + FormatMegabytes(growth) + " since warm-up (maximum " + to_string(maxMemoryGrowthMegabytes) + "MB)");
+    }
+
+    check(measuredCounters.malformedBatches == 0, to_string(measuredCounters.malformedBatches) + " malformed message batches");
+    check(stateError.empty(), stateError.empty() ? "game state consistent" : "game state: " + stateError);
+
+    return passed;
+}
+
+void PrintUsage(const char* program)
+{
+    cerr << "Usage: " << program << " [--duration seconds] [--warm-up seconds] [--report-interval seconds] [--bots n]\n"
+        << "    [--port n] [--seed n] [--config server.cfg] [--server-log]\n"
+        << "    [--loss 0.02] [--delay ms] [--jitter ms] [--reorder 0.01] [--duplicate 0.005]\n"
+        << "    [--churn per-second] [--storm-interval seconds]\n"
+        << "    [--min-throughput guesses-per-second] [--max-p99 ms] [--max-memory-growth MB]" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    randomSeed = random_device{}();
+
+    // snappier rounds than the defaults, so an hour covers a lot of them; --config overrides
+    serverConfigPath = "";
+    serverConfig.roomSize = 4;
+    serverConfig.lobbyTimeout = 2000;
+    serverConfig.timeToWaitForNextGame = 500;
+    serverConfig.turnTimeout = 5000;
+    serverConfig.drainTimeout = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--server-log") serverLog = true;
+        else if (argument == "--duration" && hasValue) durationSeconds = atoi(argv[++i]);
+        else if (argument == "--warm-up" && hasValue) warmUpSeconds = atoi(argv[++i]);
+        else if (argument == "--report-interval" && hasValue) reportIntervalSeconds = max(1, atoi(argv[++i]));
+        else if (argument == "--bots" && hasValue) botCount = max(1, atoi(argv[++i]));
+        else if (argument == "--port" && hasValue) serverPort = (enet_uint16)atoi(argv[++i]);
+        else if (argument == "--seed" && hasValue) randomSeed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        else if (argument == "--config" && hasValue) serverConfigPath = argv[++i];
+        else if (argument == "--loss" && hasValue) lossRate = atof(argv[++i]);
+        else if (argument == "--delay" && hasValue) delayMilliseconds = atoi(argv[++i]);
+        else if (argument == "--jitter" && hasValue) jitterMilliseconds = atoi(argv[++i]);
+        else if (argument == "--reorder" && hasValue) reorderRate = atof(argv[++i]);
+        else if (argument == "--duplicate" && hasValue) duplicateRate = atof(argv[++i]);
+        else if (argument == "--churn" && hasValue) churnRate = atof(argv[++i]);
+        else if (argument == "--storm-interval" && hasValue) stormIntervalSeconds = atoi(argv[++i]);
+        else if (argument == "--min-throughput" && hasValue) minGuessesPerSecond = atof(argv[++i]);
+        else if (argument == "--max-p99" && hasValue) maxResultP99Milliseconds = atoi(argv[++i]);
+        else if (argument == "--max-memory-growth" && hasValue) maxMemoryGrowthMegabytes = atoi(argv[++i]);
+        else
+        {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    warmUpSeconds = min(warmUpSeconds, durationSeconds / 2);
+    proxyPort = (enet_uint16)(serverPort + 1);
+    randomEngine.seed(randomSeed);
+    srand(randomSeed);
+
+    string configError;
+
+    if (!serverConfigPath.empty() && !LoadServerConfig(serverConfigPath, serverConfig, configError))
+    {
+        cerr << "Could not load " << serverConfigPath << ": " << configError << endl;
+        return EXIT_FAILURE;
+    }
+
+    ApplyServerConfig();
+
+    report << "[soak] seed=" << randomSeed << " bots=" << botCount << " duration=" << durationSeconds << "s"
+        << " loss=" << lossRate << " delay=" << delayMilliseconds << "ms jitter=" << jitterMilliseconds << "ms"
+        << " reorder=" << reorderRate << " duplicate=" << duplicateRate
+        << " churn=" << churnRate << "/s storm-interval=" << stormIntervalSeconds << "s" << endl;
+
+    if (!serverLog)
+    {
+        cout.setstate(ios_base::badbit);
+    }
+
+    if (enet_initialize() != 0)
+    {
+        cerr << "An error occurred while initializing ENet." << endl;
+        return EXIT_FAILURE;
+    }
+
+    atexit(enet_deinitialize);
+
+    // room for every bot twice over, since connections left by going quiet linger until they time out
+    maxServerPeers = (size_t)botCount * 3;
+
+    if (!CreateServer())
+    {
+        cerr << "Could not create the server on port " << serverPort << "." << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!CreateProxy())
+    {
+        cerr << "Could not create the proxy on port " << proxyPort << "." << endl;
+        DestroyProxy();
+        return EXIT_FAILURE;
+    }
+
+    botHost = enet_host_create(NULL, (size_t)botCount * 2, 2, 0, 0);
+
+    if (!botHost)
+    {
+        cerr << "Could not create the bots' client host." << endl;
+        DestroyProxy();
+        return EXIT_FAILURE;
+    }
+
+    enet_address_set_host(&proxyAddress, "127.0.0.1");
+    proxyAddress.port = proxyPort;
+
+    thread serverThread(RunServer);
+
+    proxyRunning = true;
+    proxyThread = thread(RunChaosProxy);
+
+    bots.resize((size_t)botCount);
+
+    for (size_t i = 0; i < bots.size(); i++)
+    {
+        bots[i].username = "Soak" + to_string(i);
+    }
+
+    int64_t startTime = GetClockMicroseconds();
+    int64_t endTime = startTime + (int64_t)durationSeconds * microsecondsPerSecond;
+    int64_t warmUpTime = startTime + (int64_t)warmUpSeconds * microsecondsPerSecond;
+    int64_t measureStartTime = 0;
+    int64_t reportInterval = (int64_t)reportIntervalSeconds * microsecondsPerSecond;
+    int64_t stormInterval = (int64_t)stormIntervalSeconds * microsecondsPerSecond;
+
+    int64_t nextChurnTime = startTime;
+    int64_t nextStormTime = stormInterval > 0 ? startTime + stormInterval : endTime;
+    int64_t intervalStartTime = startTime;
+    bool warmedUp = false;
+    size_t warmUpMemory = 0;
+    uint64_t stalledIntervals = 0;
+
+    while (true)
+    {
+        ServiceBots(5);
+
+        int64_t now = GetClockMicroseconds();
+
+        if (now >= nextChurnTime)
+        {
+            bool storm = now >= nextStormTime;
+
+            if (storm)
+            {
+                report << "[soak] reconnect storm" << endl;
+                nextStormTime += stormInterval;
+            }
+
+            UpdateChurn(now, storm);
+            nextChurnTime = now + churnCheckInterval;
+        }
+
+        bool finished = now >= endTime;
+
+        if (now - intervalStartTime >= reportInterval || finished)
+        {
+            WriteReport(now - startTime, now - intervalStartTime);
+
+            if (warmedUp)
+            {
+                stalledIntervals += intervalCounters.guessResults == 0 ? 1 : 0;
+                measuredCounters.Merge(intervalCounters);
+            }
+            else if (now >= warmUpTime)
+            {
+                // measuring starts with the first whole interval after the warm-up
+                warmedUp = true;
+                warmUpMemory = GetResidentMemory();
+                measureStartTime = now;
+            }
+
+            intervalCounters = SoakCounters();
+            intervalStartTime = now;
+        }
+
+        if (finished)
+        {
+            break;
+        }
+    }
+
+    int64_t measuredTime = warmedUp ? GetClockMicroseconds() - measureStartTime : 0;
+    size_t finalMemory = GetResidentMemory();
+
+    // leave cleanly, then stop the server without waiting for a round to end
+    for (SoakBot& bot : bots)
+    {
+        if (bot.peer)
+        {
+            enet_peer_disconnect(bot.peer, 0);
+            bot.peer = nullptr;
+        }
+    }
+
+    int64_t leaveDeadline = GetClockMicroseconds() + 2 * microsecondsPerSecond;
+
+    while (GetClockMicroseconds() < leaveDeadline)
+    {
+        ServiceBots(10);
+    }
+
+    shutdownRequestCount = 2;
+    serverThread.join();
+
+    proxyRunning = false;
+    proxyThread.join();
+
+    enet_host_destroy(botHost);
+    DestroyProxy();
+
+    string stateError;
+    CheckGameState(stateError);
+
+    bool passed = CheckResults(measuredTime, warmUpMemory, finalMemory, stalledIntervals, stateError);
+
+    report << "[soak] " << (passed ? "passed" : "FAILED") << endl;
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+#include <enet/enet.h>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "GuessAnalytics.h"
+#include "Lobby.h"
+#include "MessageBatch.h"
+#include "RoomCheckpoint.h"
+#include "ServerConfig.h"
+
+using namespace std;
+
+/*
+    Regression tests for the server's game logic, run by ctest.
+    Usage: NetworkedNumberGuessingGameTests [test name]
+
+    Runs every test, or only the one named. Exits non-zero if any check fails.
+*/
+
+struct Test
+{
+    string name;
+    function<void()> run;
+};
+
+int failedChecks = 0;
+
+void Check(bool condition, const string& description)
+{
+    if (!condition)
+    {
+        cout << "  FAIL " << description << endl;
+        failedChecks++;
+    }
+}
+
+bool HasMember(const vector<LobbyEntry>& members, ENetPeer* peer)
+{
+    for (const LobbyEntry& member : members)
+    {
+        if (member.peer == peer) return true;
+    }
+
+    return false;
+}
+
+// The longest waiting player has no one near their rating, but the two behind them match each other.
+void TestLobbySkipsUnmatchedOldestPlayer()
+{
+    ENetPeer peers[3] = {};
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    chrono::milliseconds timeout(60000);
+
+    Lobby lobby;
+    lobby.Enqueue({ &peers[0], 900, 0.5f, now });
+    lobby.Enqueue({ &peers[1], 10, 0.5f, now });
+    lobby.Enqueue({ &peers[2], 20, 0.5f, now });
+
+    vector<LobbyEntry> members;
+
+    Check(lobby.TryFormRoom(now, 2, 2, timeout, members), "a room forms without the oldest player");
+    Check(members.size() == 2 && HasMember(members, &peers[1]) && HasMember(members, &peers[2]),
+        "the room is the two players who match");
+    Check(lobby.Size() == 1 && lobby.Contains(&peers[0]), "the oldest player is still queued");
+
+    Check(!lobby.TryFormRoom(now + timeout, 2, 2, timeout, members), "a lone timed out player can't form a room");
+}
+
+// When the longest waiting player does have a match, they still go first.
+void TestLobbyPrefersOldestPlayer()
+{
+    ENetPeer peers[4] = {};
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    chrono::milliseconds timeout(60000);
+
+    Lobby lobby;
+    lobby.Enqueue({ &peers[0], 900, 0.5f, now });
+    lobby.Enqueue({ &peers[1], 10, 0.5f, now });
+    lobby.Enqueue({ &peers[2], 20, 0.5f, now });
+    lobby.Enqueue({ &peers[3], 910, 0.5f, now });
+
+    vector<LobbyEntry> members;
+
+    Check(lobby.TryFormRoom(now, 2, 2, timeout, members), "the oldest player's room forms");
+    Check(members.size() == 2 && HasMember(members, &peers[0]) && HasMember(members, &peers[3]),
+        "the oldest player is in the first room");
+
+    Check(lobby.TryFormRoom(now, 2, 2, timeout, members), "the next room forms");
+    Check(lobby.Size() == 0, "everyone has a room");
+}
+
+// A player who couldn't start a room is tried again once someone close to them joins.
+void TestLobbyRechecksAfterNewcomer()
+{
+    ENetPeer peers[4] = {};
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    chrono::milliseconds timeout(60000);
+
+    Lobby lobby;
+    vector<LobbyEntry> members;
+
+    lobby.Enqueue({ &peers[0], 10, 0.5f, now });
+    lobby.Enqueue({ &peers[1], 900, 0.5f, now });
+    Check(!lobby.TryFormRoom(now, 2, 2, timeout, members), "no one is close enough yet");
+
+    lobby.Enqueue({ &peers[2], 910, 0.5f, now });
+    Check(lobby.TryFormRoom(now, 2, 2, timeout, members), "a room forms once a match joins");
+    Check(members.size() == 2 && HasMember(members, &peers[1]) && HasMember(members, &peers[2]),
+        "the room is the player who waited and the newcomer");
+    Check(!lobby.TryFormRoom(now, 2, 2, timeout, members), "the remaining player still has no match");
+
+    lobby.Enqueue({ &peers[3], 900, 0.5f, now + timeout });
+    Check(lobby.TryFormRoom(now + timeout, 3, 2, timeout, members), "once timed out, the oldest player takes whoever is closest");
+    Check(members.size() == 2 && HasMember(members, &peers[0]) && HasMember(members, &peers[3]),
+        "the room is the timed out player and the only other one queued");
+}
+
+// A message too long for a batch is turned away before it can define words, so the client's
+// dictionary still matches the server's for the messages after it.
+void TestMessageBatchRejectsOversizedMessage()
+{
+    MessageEncoder encoder;
+    MessageDecoder decoder;
+    StringArena words;
+    string batch, encoded, text;
+    vector<string_view> messages;
+
+    string oversized = "Wordsmith " + string(70 * 1024, 'x') + " Lexicographer";
+
+    MessageBatchGamePacket::begin(batch);
+    Check(MessageBatchGamePacket::append(batch, "It is now Wordsmith's turn.", encoder, words, encoded), "a short message is batched");
+
+    string batchBefore = batch;
+    uint8_t entriesBefore = encoder.entryCount;
+
+    Check(!MessageBatchGamePacket::append(batch, oversized, encoder, words, encoded), "a message over 64 KiB is turned away");
+    Check(batch == batchBefore, "the batch is unchanged");
+    Check(encoder.entryCount == entriesBefore, "no words were defined");
+
+    Check(MessageBatchGamePacket::append(batch, "Lexicographer and Wordsmith", encoder, words, encoded), "the next message is batched");
+
+    bool decoded = MessageBatchGamePacket::deserialize(batch.data(), batch.size(), decoder, text, messages);
+
+    Check(decoded && messages.size() == 2, "the batch decodes");
+    Check(messages.size() == 2 && messages[0] == "It is now Wordsmith's turn." && messages[1] == "Lexicographer and Wordsmith",
+        "the messages decode to what was sent");
+}
+
+// The longest message a batch takes still fits its length field when every byte needs escaping.
+void TestMessageBatchLongestMessage()
+{
+    MessageEncoder encoder;
+    MessageDecoder decoder;
+    StringArena words;
+    string batch, encoded, text;
+    vector<string_view> messages;
+
+    string longest(maxBatchedMessageLength, (char)MT_Escape);
+
+    MessageBatchGamePacket::begin(batch);
+    Check(MessageBatchGamePacket::append(batch, longest, encoder, words, encoded), "the longest message is batched");
+
+    bool decoded = MessageBatchGamePacket::deserialize(batch.data(), batch.size(), decoder, text, messages);
+
+    Check(decoded && messages.size() == 1 && messages[0] == longest, "it decodes to what was sent");
+}
+
+// A room's guess tracking grows with the guesses made, not with the range they're made in.
+void TestGuessTrackerWideRange()
+{
+    const int maxNumber = 1 << 30;
+
+    GuessTracker tracker;
+    tracker.Reset(maxNumber);
+
+    Check(tracker.RecordGuess(maxNumber / 2, 12345) == GH_Lower, "a guess above the number is told lower");
+    Check(tracker.RecordGuess(1, 12345) == GH_Higher, "a guess below the number is told higher");
+    Check(tracker.RecordGuess(maxNumber / 2, 12345) == GH_Lower, "a repeated guess is still scored");
+    Check(tracker.duplicateGuesses == 1, "the repeat is counted as a duplicate");
+    Check(tracker.outOfRangeGuesses == 1, "the repeat, outside the range left, is counted as out of range");
+    Check(tracker.guessed.MemoryUsage() < 1024, "the guessed numbers take a few bytes, not a bit per number");
+
+    tracker.Reset(maxNumber);
+    tracker.RecordGuess(maxNumber / 2, 12345);
+
+    Check(tracker.duplicateGuesses == 0, "a new round starts with nothing guessed");
+}
+
+// Clients can send any int as a guess, including the extremes.
+void TestScoreGuessStreamsExtremeGuesses()
+{
+    vector<int> stream = { INT_MIN, INT_MAX, 50 };
+    vector<GuessStreamScore> scores = ScoreGuessStreams({ &stream }, { 50 }, 100);
+
+    int64_t expectedDistance = (int64_t)50 - INT_MIN + ((int64_t)INT_MAX - 50) + 0;
+
+    Check(scores.size() == 1 && scores[0].guesses == 3, "the stream is scored");
+    Check(scores.size() == 1 && scores[0].outOfRangeGuesses == 2, "both extremes are out of range");
+    Check(scores.size() == 1 && scores[0].distanceFromOptimal == expectedDistance, "their distance is measured without overflowing");
+}
+
+// A room smaller than a round needs would close as soon as it formed, so such a config is turned away.
+void TestServerConfigRejectsRoomsTooSmallToStart()
+{
+    string path = (filesystem::temp_directory_path() / "nngg-test-server.cfg").string();
+
+    {
+        ofstream file(path);
+        file << "requiredNumberOfPlayersToBegin = 3\nroomSize = 2\n";
+    }
+
+    ServerConfig config;
+    string error;
+
+    Check(!LoadServerConfig(path, config, error), "the config is rejected");
+    Check(config.roomSize == ServerConfig().roomSize && config.requiredNumberOfPlayersToBegin == ServerConfig().requiredNumberOfPlayersToBegin,
+        "the current config is kept");
+
+    {
+        ofstream file(path);
+        file << "requiredNumberOfPlayersToBegin = 3\nroomSize = 3\n";
+    }
+
+    Check(LoadServerConfig(path, config, error), "a room exactly big enough is accepted");
+    Check(config.roomSize == 3 && config.requiredNumberOfPlayersToBegin == 3, "and applied");
+
+    filesystem::remove(path);
+}
+
+// A checkpoint file whose header says it has no slots still opens, and grows when a room needs one.
+void TestRoomCheckpointGrowsFromNoSlots()
+{
+    string path = (filesystem::temp_directory_path() / "nngg-test-rooms.ckpt").string();
+
+    {
+        // magic "NNGC", version 1, slot count 0
+        const uint32_t header[4] = { 0x43474E4E, 1, 0, 0 };
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    RoomCheckpointFile checkpoints;
+    string error;
+
+    Check(checkpoints.Open(path, false, error), "the file opens");
+
+    int slot = checkpoints.AllocateSlot();
+    Check(slot >= 0, "a slot is allocated");
+
+    RoomSnapshot snapshot;
+    snapshot.roomId = 7;
+    checkpoints.WriteSlot(slot, snapshot);
+
+    vector<RoomSnapshot> snapshots = checkpoints.ReadSnapshots();
+    Check(snapshots.size() == 1 && snapshots[0].roomId == 7, "the room is checkpointed in the new slot");
+
+    checkpoints.Close();
+    filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+    string nameFilter = argc > 1 ? argv[1] : "";
+
+    vector<Test> tests = {
+        { "lobby-skips-unmatched-oldest", TestLobbySkipsUnmatchedOldestPlayer },
+        { "lobby-prefers-oldest", TestLobbyPrefersOldestPlayer },
+        { "lobby-rechecks-after-newcomer", TestLobbyRechecksAfterNewcomer },
+        { "message-batch-rejects-oversized", TestMessageBatchRejectsOversizedMessage },
+        { "message-batch-longest-message", TestMessageBatchLongestMessage },
+        { "guess-tracker-wide-range", TestGuessTrackerWideRange },
+        { "score-guess-streams-extreme-guesses", TestScoreGuessStreamsExtremeGuesses },
+        { "server-config-rejects-rooms-too-small", TestServerConfigRejectsRoomsTooSmallToStart },
+        { "room-checkpoint-grows-from-no-slots", TestRoomCheckpointGrowsFromNoSlots },
+    };
+
+    int failedTests = 0;
+
+    for (const Test& test : tests)
+    {
+        if (!nameFilter.empty() && test.name != nameFilter)
+        {
+            continue;
+        }
+
+        int failedBefore = failedChecks;
+        test.run();
+
+        bool passed = failedChecks == failedBefore;
+        cout << (passed ? "PASS " : "FAIL ") << test.name << endl;
+
+        if (!passed) failedTests++;
+    }
+
+    return failedTests == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}